@@ -0,0 +1,924 @@
+//
+// load_gen.cpp
+// ~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Load generator for the server. It starts a server in the same process,
+// serving generated files and a few callback routes on the loopback
+// interface, drives it from a number of keep-alive connections and writes the
+// results to stdout as JSON, so that runs can be kept and compared. Build it
+// from the top directory like micro_bench.cpp, with the one command
+//
+//   g++ -std=c++17 -O2 -DNDEBUG -I. -o load_gen bench/load_gen.cpp
+//     $(ls *.cpp | grep -v '^main.cpp$') -lpthread
+//
+// and run it as load_gen [--option=value ...]; load_gen --help lists the
+// options.
+//
+// Without --rate the load is closed-loop: each connection sends its next
+// request as soon as the previous reply has arrived, which measures the most
+// the server can do. With --rate the load is open-loop: requests are due at a
+// constant rate whatever the server does, and latency is measured from when a
+// request was due rather than when it was sent. A client that waits for a
+// slow reply before sending again would otherwise leave out exactly the
+// requests that reply delayed (coordinated omission), and hide the stall from
+// the percentiles. The time from sending to the reply is reported as well,
+// as the service time.
+//
+
+#include <algorithm>
+#include <array>
+#include <asio.hpp>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include "inc/asio_http_server.h"
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+/// The command line options.
+struct settings
+{
+  std::string port = "18090";
+  std::size_t connections = 64;
+  std::size_t threads = 2;
+  std::size_t shards = 1;
+  std::size_t workers = 0;
+  std::size_t keep_alive_requests = 0;
+  double rate = 0;
+  double duration = 10;
+  double warmup = 2;
+  std::size_t post_bytes = 4096;
+  unsigned mix[3] = { 60, 30, 10 };
+};
+
+void print_usage()
+{
+  std::fprintf(stderr,
+      "Usage: load_gen [--option=value ...]\n"
+      "  --port=N                 loopback port to serve on (18090)\n"
+      "  --connections=N          client connections (64)\n"
+      "  --threads=N              client threads (2)\n"
+      "  --shards=N               server shards, 0 for one per CPU (1)\n"
+      "  --workers=N              server worker threads (0)\n"
+      "  --keep-alive-requests=N  requests per server connection, 0 for no\n"
+      "                           limit (0)\n"
+      "  --rate=R                 requests per second over all connections;\n"
+      "                           0 sends as fast as replies arrive (0)\n"
+      "  --duration=S             seconds measured (10)\n"
+      "  --warmup=S               seconds run before measuring (2)\n"
+      "  --post-bytes=N           size of POST bodies (4096)\n"
+      "  --mix=static:W,callback:W,post:W\n"
+      "                           relative weights of the kinds of request\n"
+      "                           (static:60,callback:30,post:10)\n");
+}
+
+/// The kinds of request in the mix: files from the document root, requests
+/// answered by callback routes, and POSTs with a body.
+enum request_kind { static_file, callback, post, kind_count };
+
+const char* kind_names[kind_count] = { "static", "callback", "post" };
+
+bool to_number(const std::string& text, double& value)
+{
+  char* end = nullptr;
+  value = std::strtod(text.c_str(), &end);
+  return !text.empty() && *end == '\0' && value >= 0;
+}
+
+bool to_number(const std::string& text, std::size_t& value)
+{
+  char* end = nullptr;
+  value = std::strtoull(text.c_str(), &end, 10);
+  return !text.empty() && text[0] != '-' && *end == '\0';
+}
+
+bool parse_mix(const std::string& text, unsigned (&mix)[kind_count])
+{
+  for (unsigned& weight: mix)
+    weight = 0;
+
+  std::size_t begin = 0;
+  while (begin <= text.size())
+  {
+    std::size_t end = text.find(',', begin);
+    if (end == std::string::npos)
+      end = text.size();
+    std::string item = text.substr(begin, end - begin);
+    std::size_t colon = item.find(':');
+    if (colon == std::string::npos)
+      return false;
+    std::string name = item.substr(0, colon);
+    std::size_t weight;
+    if (!to_number(item.substr(colon + 1), weight))
+      return false;
+    std::size_t kind = 0;
+    while (kind < kind_count && name != kind_names[kind])
+      ++kind;
+    if (kind == kind_count)
+      return false;
+    mix[kind] = static_cast<unsigned>(weight);
+    begin = end + 1;
+  }
+  return mix[static_file] + mix[callback] + mix[post] != 0;
+}
+
+bool parse_arguments(int argc, char* argv[], settings& s)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    std::size_t equals = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || equals == std::string::npos)
+      return false;
+    std::string name = arg.substr(2, equals - 2);
+    std::string value = arg.substr(equals + 1);
+
+    bool ok;
+    if (name == "port")
+      ok = !(s.port = value).empty();
+    else if (name == "connections")
+      ok = to_number(value, s.connections) && s.connections != 0;
+    else if (name == "threads")
+      ok = to_number(value, s.threads) && s.threads != 0;
+    else if (name == "shards")
+      ok = to_number(value, s.shards);
+    else if (name == "workers")
+      ok = to_number(value, s.workers);
+    else if (name == "keep-alive-requests")
+      ok = to_number(value, s.keep_alive_requests);
+    else if (name == "rate")
+      ok = to_number(value, s.rate);
+    else if (name == "duration")
+      ok = to_number(value, s.duration) && s.duration > 0;
+    else if (name == "warmup")
+      ok = to_number(value, s.warmup);
+    else if (name == "post-bytes")
+      ok = to_number(value, s.post_bytes);
+    else if (name == "mix")
+      ok = parse_mix(value, s.mix);
+    else
+      ok = false;
+    if (!ok)
+      return false;
+  }
+  return true;
+}
+
+/// Latencies in nanoseconds. The buckets are laid out like those of histogram
+/// in metrics.hpp, but with 128 of them per power of two rather than four, so
+/// that percentiles are within 1% of the true value.
+class latency_histogram
+{
+public:
+  static const std::size_t sub_bits = 7;
+  static const std::size_t max_bits = 40;
+  static const std::size_t bucket_count =
+    (max_bits - sub_bits + 1) << sub_bits;
+
+  latency_histogram()
+    : buckets_(bucket_count)
+  {
+  }
+
+  void record(clock_type::duration d)
+  {
+    std::int64_t ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    std::uint64_t value = ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+    ++buckets_[bucket_of(value)];
+    ++count_;
+    sum_ += value;
+    if (value > max_)
+      max_ = value;
+  }
+
+  void merge(const latency_histogram& other)
+  {
+    for (std::size_t i = 0; i < bucket_count; ++i)
+      buckets_[i] += other.buckets_[i];
+    count_ += other.count_;
+    sum_ += other.sum_;
+    if (other.max_ > max_)
+      max_ = other.max_;
+  }
+
+  std::uint64_t count() const { return count_; }
+
+  std::uint64_t max() const { return max_; }
+
+  double mean() const { return count_ != 0 ? double(sum_) / count_ : 0; }
+
+  /// The value below which the fraction q of the values lie: the highest
+  /// value in the bucket holding that rank.
+  std::uint64_t percentile(double q) const
+  {
+    std::uint64_t rank = static_cast<std::uint64_t>(q * count_ + 0.999999);
+    if (rank == 0)
+      rank = 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucket_count; ++i)
+    {
+      seen += buckets_[i];
+      if (seen >= rank)
+      {
+        std::uint64_t highest = i + 1 < bucket_count
+          ? lower_bound(i + 1) - 1 : max_;
+        return highest < max_ ? highest : max_;
+      }
+    }
+    return max_;
+  }
+
+private:
+  static std::uint64_t lower_bound(std::size_t bucket)
+  {
+    const std::size_t sub_count = std::size_t(1) << sub_bits;
+    if (bucket < sub_count)
+      return bucket;
+    std::size_t bit = (bucket >> sub_bits) + sub_bits - 1;
+    std::uint64_t sub = bucket & (sub_count - 1);
+    return (sub_count + sub) << (bit - sub_bits);
+  }
+
+  static std::size_t bucket_of(std::uint64_t value)
+  {
+    const std::size_t sub_count = std::size_t(1) << sub_bits;
+    if (value < sub_count)
+      return static_cast<std::size_t>(value);
+    std::size_t bit = 63 - static_cast<std::size_t>(__builtin_clzll(value));
+    if (bit >= max_bits)
+      return bucket_count - 1;
+    return ((bit - sub_bits + 1) << sub_bits)
+      + static_cast<std::size_t>((value >> (bit - sub_bits)) & (sub_count - 1));
+  }
+
+  std::vector<std::uint64_t> buckets_;
+  std::uint64_t count_ = 0;
+  std::uint64_t sum_ = 0;
+  std::uint64_t max_ = 0;
+};
+
+/// What the clients of one thread measured. Only replies to requests due
+/// once measuring has begun are counted.
+struct client_stats
+{
+  /// From when each request was due to its reply.
+  latency_histogram latency;
+
+  /// From when each request was sent to its reply.
+  latency_histogram service_time;
+
+  std::uint64_t requests[kind_count] = {};
+  std::uint64_t bytes_received = 0;
+
+  /// Replies by status class: 1xx to 5xx.
+  std::array<std::uint64_t, 5> replies{};
+
+  /// Requests that failed: connection errors and malformed replies.
+  std::uint64_t errors = 0;
+
+  /// Requests due while measuring that were still unanswered when the run
+  /// was cut off.
+  std::uint64_t unanswered = 0;
+};
+
+/// The run, shared by all clients and fixed before any of them starts.
+struct load_plan
+{
+  asio::ip::tcp::endpoint endpoint;
+
+  /// When the warm-up begins, when measuring begins and when no more
+  /// requests are due.
+  clock_type::time_point start;
+  clock_type::time_point measure_start;
+  clock_type::time_point end;
+
+  /// Time between the requests of one connection in open-loop mode, zero in
+  /// closed-loop mode.
+  clock_type::duration interval;
+
+  std::size_t connections;
+
+  /// Complete requests of each kind, used in turn.
+  std::vector<std::string> requests[kind_count];
+  unsigned weights[kind_count];
+};
+
+/// How long the server has to answer the requests outstanding at the end of
+/// the run before their connections are closed.
+const std::chrono::seconds drain_time(5);
+
+class client;
+
+/// A thread running some of the clients on its own io_context.
+struct client_thread
+{
+  asio::io_context io_context;
+
+  /// Cuts the run off once the drain time has passed.
+  asio::steady_timer drain{io_context};
+
+  client_stats stats;
+  std::vector<std::shared_ptr<client>> clients;
+  std::size_t active = 0;
+};
+
+/// One connection to the server, sending a request at a time.
+class client
+  : public std::enable_shared_from_this<client>
+{
+public:
+  client(client_thread& thread, const load_plan& plan, std::size_t index)
+    : thread_(thread),
+      plan_(plan),
+      index_(index),
+      socket_(thread.io_context),
+      timer_(thread.io_context),
+      random_(0x9e3779b97f4a7c15ull * (index + 1))
+  {
+  }
+
+  /// Connect and start sending. Open-loop connections are staggered over
+  /// the interval so that their requests do not all fall due together.
+  void start()
+  {
+    ++thread_.active;
+    due_ = plan_.start + plan_.interval * index_ / plan_.connections;
+    do_connect();
+  }
+
+  /// Close the connection and send no more requests.
+  void stop()
+  {
+    if (stopped_)
+      return;
+    stopped_ = true;
+    asio::error_code ignored_ec;
+    socket_.close(ignored_ec);
+    timer_.cancel();
+    if (--thread_.active == 0)
+      thread_.drain.cancel();
+  }
+
+  /// Stop once the run has gone on too long. The request in flight, and in
+  /// open-loop mode every request due since, has not been answered; each is
+  /// recorded as taking until now, the least it would have taken.
+  void cut_off()
+  {
+    if (stopped_)
+      return;
+
+    clock_type::time_point now = clock_type::now();
+    if (waiting_ || !closed_loop())
+    {
+      for (clock_type::time_point due = due_; due < plan_.end;
+          due += plan_.interval)
+      {
+        if (due >= plan_.measure_start)
+        {
+          thread_.stats.latency.record(now - due);
+          ++thread_.stats.unanswered;
+        }
+        if (closed_loop())
+          break;
+      }
+    }
+    stop();
+  }
+
+private:
+  bool closed_loop() const
+  {
+    return plan_.interval == clock_type::duration::zero();
+  }
+
+  /// Whether the run is over for this connection.
+  bool done() const
+  {
+    return (closed_loop() ? clock_type::now() : due_) >= plan_.end;
+  }
+
+  void do_connect()
+  {
+    auto self(shared_from_this());
+    socket_.async_connect(plan_.endpoint,
+        [this, self](std::error_code ec)
+        {
+          if (stopped_)
+            return;
+
+          if (ec)
+          {
+            // Retry after a pause rather than spin while the server refuses.
+            count_error();
+            asio::error_code ignored_ec;
+            socket_.close(ignored_ec);
+            timer_.expires_after(std::chrono::milliseconds(100));
+            timer_.async_wait(
+                [this, self](std::error_code ec)
+                {
+                  if (stopped_ || ec)
+                    return;
+                  if (done())
+                    stop();
+                  else
+                    do_connect();
+                });
+            return;
+          }
+
+          asio::error_code ignored_ec;
+          socket_.set_option(asio::ip::tcp::no_delay(true), ignored_ec);
+          next_request();
+        });
+  }
+
+  /// Send the next request when it is due.
+  void next_request()
+  {
+    if (done())
+    {
+      stop();
+      return;
+    }
+
+    if (closed_loop() || due_ <= clock_type::now())
+    {
+      do_write();
+      return;
+    }
+
+    auto self(shared_from_this());
+    timer_.expires_at(due_);
+    timer_.async_wait(
+        [this, self](std::error_code ec)
+        {
+          if (stopped_ || ec)
+            return;
+          do_write();
+        });
+  }
+
+  /// Pick a kind of request by weight, with a xorshift generator.
+  request_kind pick_kind()
+  {
+    random_ ^= random_ << 13;
+    random_ ^= random_ >> 7;
+    random_ ^= random_ << 17;
+    unsigned total = plan_.weights[static_file] + plan_.weights[callback]
+      + plan_.weights[post];
+    unsigned n = static_cast<unsigned>(random_ % total);
+    unsigned kind = 0;
+    while (n >= plan_.weights[kind])
+      n -= plan_.weights[kind++];
+    return static_cast<request_kind>(kind);
+  }
+
+  void do_write()
+  {
+    kind_ = pick_kind();
+    const std::vector<std::string>& requests = plan_.requests[kind_];
+    const std::string& request = requests[next_[kind_]++ % requests.size()];
+
+    sent_ = clock_type::now();
+    if (closed_loop())
+      due_ = sent_;
+    waiting_ = true;
+
+    auto self(shared_from_this());
+    asio::async_write(socket_, asio::buffer(request),
+        [this, self](std::error_code ec, std::size_t)
+        {
+          if (stopped_)
+            return;
+          if (ec)
+            fail();
+          else
+            do_read_header();
+        });
+  }
+
+  void do_read_header()
+  {
+    auto self(shared_from_this());
+    asio::async_read_until(socket_, asio::dynamic_buffer(buffer_), "\r\n\r\n",
+        [this, self](std::error_code ec, std::size_t header_size)
+        {
+          if (stopped_)
+            return;
+
+          int status = 0;
+          std::size_t length = 0;
+          bool close = false;
+          if (ec || !parse_header(std::string_view(buffer_.data(),
+                  header_size), status, length, close))
+          {
+            fail();
+            return;
+          }
+
+          std::size_t size = header_size + length;
+          if (buffer_.size() >= size)
+          {
+            complete(size, status, close);
+            return;
+          }
+
+          asio::async_read(socket_, asio::dynamic_buffer(buffer_),
+              asio::transfer_exactly(size - buffer_.size()),
+              [this, self, size, status, close](std::error_code ec,
+                std::size_t)
+              {
+                if (stopped_)
+                  return;
+                if (ec)
+                  fail();
+                else
+                  complete(size, status, close);
+              });
+        });
+  }
+
+  /// Case-insensitive comparison with a lower case name.
+  static bool equals_lower(std::string_view text, std::string_view lower)
+  {
+    if (text.size() != lower.size())
+      return false;
+    for (std::size_t i = 0; i < text.size(); ++i)
+    {
+      char c = text[i];
+      if (c >= 'A' && c <= 'Z')
+        c = static_cast<char>(c - 'A' + 'a');
+      if (c != lower[i])
+        return false;
+    }
+    return true;
+  }
+
+  /// Find the status, Content-Length and whether the server closes the
+  /// connection. Replies without a Content-Length are not expected from
+  /// the requests sent, and are treated as malformed.
+  static bool parse_header(std::string_view header, int& status,
+      std::size_t& length, bool& close)
+  {
+    if (header.size() < 12 || header.compare(0, 5, "HTTP/") != 0)
+      return false;
+    status = std::atoi(std::string(header.substr(9, 3)).c_str());
+
+    bool has_length = false;
+    std::size_t line = header.find("\r\n") + 2;
+    while (line < header.size())
+    {
+      std::size_t line_end = header.find("\r\n", line);
+      std::string_view field = header.substr(line, line_end - line);
+      line = line_end + 2;
+
+      std::size_t colon = field.find(':');
+      if (colon == std::string_view::npos)
+        continue;
+      std::string_view name = field.substr(0, colon);
+      std::string_view value = field.substr(colon + 1);
+      while (!value.empty() && value.front() == ' ')
+        value.remove_prefix(1);
+
+      if (equals_lower(name, "content-length"))
+      {
+        has_length = true;
+        length = std::strtoull(std::string(value).c_str(), nullptr, 10);
+      }
+      else if (equals_lower(name, "connection"))
+        close = equals_lower(value, "close");
+    }
+    return status >= 100 && status < 600 && has_length;
+  }
+
+  void complete(std::size_t size, int status, bool close)
+  {
+    clock_type::time_point now = clock_type::now();
+    buffer_.erase(0, size);
+    waiting_ = false;
+
+    if (due_ >= plan_.measure_start)
+    {
+      client_stats& stats = thread_.stats;
+      stats.latency.record(now - due_);
+      stats.service_time.record(now - sent_);
+      ++stats.requests[kind_];
+      stats.bytes_received += size;
+      ++stats.replies[status / 100 - 1];
+    }
+
+    due_ += plan_.interval;
+    if (close)
+      reconnect();
+    else
+      next_request();
+  }
+
+  /// The request failed; skip it and carry on over a new connection.
+  void fail()
+  {
+    count_error();
+    waiting_ = false;
+    due_ += plan_.interval;
+    reconnect();
+  }
+
+  void count_error()
+  {
+    if (clock_type::now() >= plan_.measure_start)
+      ++thread_.stats.errors;
+  }
+
+  void reconnect()
+  {
+    asio::error_code ignored_ec;
+    socket_.close(ignored_ec);
+    buffer_.clear();
+    if (done())
+      stop();
+    else
+      do_connect();
+  }
+
+  client_thread& thread_;
+  const load_plan& plan_;
+  std::size_t index_;
+  asio::ip::tcp::socket socket_;
+  asio::steady_timer timer_;
+  std::string buffer_;
+  std::uint64_t random_;
+
+  /// The request in flight, when it was due and when it was sent.
+  request_kind kind_ = static_file;
+  clock_type::time_point due_;
+  clock_type::time_point sent_;
+  bool waiting_ = false;
+  bool stopped_ = false;
+
+  /// Next request to use of each kind.
+  std::size_t next_[kind_count] = {};
+};
+
+/// The files served as static content, with their sizes.
+const struct
+{
+  const char* name;
+  std::size_t size;
+} static_files[] =
+{
+  { "index.html", 2 * 1024 },
+  { "style.css", 16 * 1024 },
+  { "app.js", 128 * 1024 },
+};
+
+/// Fill a new temporary directory with the static files.
+std::filesystem::path make_doc_root()
+{
+  std::string path =
+    (std::filesystem::temp_directory_path() / "load_gen.XXXXXX").string();
+  if (::mkdtemp(&path[0]) == nullptr)
+    throw std::runtime_error("cannot create document root " + path);
+
+  for (auto& f: static_files)
+  {
+    std::ofstream out(std::filesystem::path(path) / f.name,
+        std::ios::binary);
+    std::string line = "/* load generator content */\n";
+    for (std::size_t n = 0; n < f.size; n += line.size())
+      out.write(line.data(), std::min(line.size(), f.size - n));
+    if (!out)
+      throw std::runtime_error("cannot write document root " + path);
+  }
+  return path;
+}
+
+void make_requests(load_plan& plan, const settings& s)
+{
+  const std::string host = "Host: 127.0.0.1\r\n";
+
+  for (auto& f: static_files)
+    plan.requests[static_file].push_back(
+        std::string("GET /") + f.name + " HTTP/1.1\r\n" + host + "\r\n");
+
+  plan.requests[callback].push_back(
+      "GET /api/hello?name=load HTTP/1.1\r\n" + host + "\r\n");
+  plan.requests[callback].push_back(
+      "GET /api/users/42 HTTP/1.1\r\n" + host + "\r\n");
+
+  plan.requests[post].push_back("POST /api/echo HTTP/1.1\r\n" + host
+      + "Content-Type: application/octet-stream\r\n"
+      + "Content-Length: " + std::to_string(s.post_bytes) + "\r\n\r\n"
+      + std::string(s.post_bytes, 'p'));
+
+  for (std::size_t i = 0; i < kind_count; ++i)
+    plan.weights[i] = s.mix[i];
+}
+
+void add_routes(asio_http_server& server)
+{
+  server.add_route("GET", "/api/hello",
+      [](const http::server::request& req, http::server::reply& rep)
+      {
+        std::string name;
+        if (!req.query_args().find("name", name))
+          name = "world";
+        rep.status = http::server::reply::ok;
+        rep.content = "hello " + name;
+      });
+  server.add_route("GET", "/api/users/:id",
+      [](const http::server::request& req, http::server::reply& rep)
+      {
+        rep.status = http::server::reply::ok;
+        rep.content = "{\"id\":" + req.route_params.at("id")
+          + ",\"name\":\"user\"}";
+      });
+  server.add_route("POST", "/api/echo",
+      [](const http::server::request& req, http::server::reply& rep)
+      {
+        rep.status = http::server::reply::ok;
+        rep.content = "received " + std::to_string(req.content.size());
+      });
+}
+
+void print_latency(const char* name, const latency_histogram& h)
+{
+  std::printf("  \"%s\": { \"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+      "\"p99\": %.1f, \"p99.9\": %.1f, \"max\": %.1f }",
+      name, h.mean() / 1e3, h.percentile(0.5) / 1e3,
+      h.percentile(0.9) / 1e3, h.percentile(0.99) / 1e3,
+      h.percentile(0.999) / 1e3, h.max() / 1e3);
+}
+
+void print_results(const settings& s, const client_stats& stats)
+{
+  std::uint64_t requests = 0;
+  for (std::uint64_t n: stats.requests)
+    requests += n;
+
+  std::printf("{\n");
+  std::printf("  \"mode\": \"%s\",\n", s.rate > 0 ? "open" : "closed");
+  std::printf("  \"target_rate\": %.1f,\n", s.rate);
+  std::printf("  \"connections\": %zu,\n", s.connections);
+  std::printf("  \"client_threads\": %zu,\n", s.threads);
+  std::printf("  \"server_shards\": %zu,\n", s.shards);
+  std::printf("  \"server_workers\": %zu,\n", s.workers);
+  std::printf("  \"duration_s\": %.1f,\n", s.duration);
+  std::printf("  \"warmup_s\": %.1f,\n", s.warmup);
+  std::printf("  \"post_bytes\": %zu,\n", s.post_bytes);
+  std::printf("  \"mix\": { \"static\": %u, \"callback\": %u, \"post\": %u },\n",
+      s.mix[static_file], s.mix[callback], s.mix[post]);
+  std::printf("  \"requests\": %llu,\n",
+      static_cast<unsigned long long>(requests));
+  std::printf("  \"requests_by_kind\": { \"static\": %llu, \"callback\": %llu, "
+      "\"post\": %llu },\n",
+      static_cast<unsigned long long>(stats.requests[static_file]),
+      static_cast<unsigned long long>(stats.requests[callback]),
+      static_cast<unsigned long long>(stats.requests[post]));
+  std::printf("  \"replies\": { \"1xx\": %llu, \"2xx\": %llu, \"3xx\": %llu, "
+      "\"4xx\": %llu, \"5xx\": %llu },\n",
+      static_cast<unsigned long long>(stats.replies[0]),
+      static_cast<unsigned long long>(stats.replies[1]),
+      static_cast<unsigned long long>(stats.replies[2]),
+      static_cast<unsigned long long>(stats.replies[3]),
+      static_cast<unsigned long long>(stats.replies[4]));
+  std::printf("  \"errors\": %llu,\n",
+      static_cast<unsigned long long>(stats.errors));
+  std::printf("  \"unanswered\": %llu,\n",
+      static_cast<unsigned long long>(stats.unanswered));
+  std::printf("  \"throughput_rps\": %.1f,\n", requests / s.duration);
+  std::printf("  \"received_mb_s\": %.2f,\n",
+      stats.bytes_received / s.duration / 1e6);
+  std::printf("  \"latency_unit\": \"us\",\n");
+  print_latency("latency", stats.latency);
+  std::printf(",\n");
+  print_latency("service_time", stats.service_time);
+  std::printf("\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  settings s;
+  if (!parse_arguments(argc, argv, s))
+  {
+    print_usage();
+    return 1;
+  }
+
+  std::filesystem::path doc_root;
+  try
+  {
+    doc_root = make_doc_root();
+
+    http::server::options opts;
+    opts.shards = s.shards;
+    opts.worker_threads = s.workers;
+    opts.max_keep_alive_requests = s.keep_alive_requests;
+
+    // The server is not destroyed: the interface has no virtual destructor.
+    // It is stopped with SIGTERM, as when run from a shell, and the process
+    // exits soon after.
+    asio_http_server* server = create_asio_http_server_with_options(
+        "127.0.0.1", s.port, doc_root.string(), opts);
+    add_routes(*server);
+    std::thread server_thread([server]() { server->run(); });
+
+    load_plan plan;
+    plan.endpoint = asio::ip::tcp::endpoint(
+        asio::ip::make_address("127.0.0.1"),
+        static_cast<unsigned short>(std::stoul(s.port)));
+    plan.connections = s.connections;
+    plan.interval = s.rate > 0
+      ? std::chrono::duration_cast<clock_type::duration>(
+          std::chrono::duration<double>(s.connections / s.rate))
+      : clock_type::duration::zero();
+    make_requests(plan, s);
+
+    std::vector<std::unique_ptr<client_thread>> threads;
+    for (std::size_t i = 0; i < s.threads; ++i)
+      threads.emplace_back(new client_thread);
+    for (std::size_t i = 0; i < s.connections; ++i)
+    {
+      client_thread& t = *threads[i % s.threads];
+      t.clients.push_back(std::make_shared<client>(t, plan, i));
+    }
+
+    plan.start = clock_type::now();
+    plan.measure_start = plan.start
+      + std::chrono::duration_cast<clock_type::duration>(
+          std::chrono::duration<double>(s.warmup));
+    plan.end = plan.measure_start
+      + std::chrono::duration_cast<clock_type::duration>(
+          std::chrono::duration<double>(s.duration));
+
+    std::vector<std::thread> runners;
+    for (auto& t: threads)
+    {
+      client_thread* thread = t.get();
+      for (auto& c: thread->clients)
+        c->start();
+      thread->drain.expires_at(plan.end + drain_time);
+      thread->drain.async_wait(
+          [thread](std::error_code ec)
+          {
+            if (ec)
+              return;
+            for (auto& c: thread->clients)
+              c->cut_off();
+          });
+      runners.emplace_back([thread]() { thread->io_context.run(); });
+    }
+    for (auto& r: runners)
+      r.join();
+
+    client_stats total;
+    for (auto& t: threads)
+    {
+      const client_stats& stats = t->stats;
+      total.latency.merge(stats.latency);
+      total.service_time.merge(stats.service_time);
+      for (std::size_t i = 0; i < kind_count; ++i)
+        total.requests[i] += stats.requests[i];
+      for (std::size_t i = 0; i < total.replies.size(); ++i)
+        total.replies[i] += stats.replies[i];
+      total.bytes_received += stats.bytes_received;
+      total.errors += stats.errors;
+      total.unanswered += stats.unanswered;
+    }
+    print_results(s, total);
+
+    std::raise(SIGTERM);
+    server_thread.join();
+  }
+  catch (std::exception& e)
+  {
+    std::fprintf(stderr, "load_gen: %s\n", e.what());
+    if (!doc_root.empty())
+      std::filesystem::remove_all(doc_root);
+    return 1;
+  }
+
+  std::filesystem::remove_all(doc_root);
+  return 0;
+}
@@ -0,0 +1,99 @@
+//
+// char_scan.cpp
+// ~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "char_scan.hpp"
+
+#if !defined(HTTP_SERVER_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) \
+  && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define HTTP_SERVER_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace http {
+namespace server {
+namespace char_scan {
+
+namespace {
+
+const char* find_scalar(const char* p, const char* end, char extra)
+{
+  for (; p != end; ++p)
+  {
+    unsigned char c = static_cast<unsigned char>(*p);
+    if (c < 0x20 || c == 0x7f || *p == extra)
+      return p;
+  }
+  return end;
+}
+
+#if defined(HTTP_SERVER_SIMD_X86)
+
+const char* find_sse2(const char* p, const char* end, char extra)
+{
+  const __m128i ctl_max = _mm_set1_epi8(0x1f);
+  const __m128i del = _mm_set1_epi8(0x7f);
+  const __m128i x = _mm_set1_epi8(extra);
+  while (end - p >= 16)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    // An unsigned byte is <= 0x1f exactly when min(byte, 0x1f) == byte.
+    __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(v, ctl_max), v);
+    __m128i hit = _mm_or_si128(ctl,
+        _mm_or_si128(_mm_cmpeq_epi8(v, del), _mm_cmpeq_epi8(v, x)));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask != 0)
+      return p + __builtin_ctz(static_cast<unsigned>(mask));
+    p += 16;
+  }
+  return find_scalar(p, end, extra);
+}
+
+#endif // defined(HTTP_SERVER_SIMD_X86)
+
+const char* find_either_scalar(const char* p, const char* end, char a, char b)
+{
+  for (; p != end; ++p)
+  {
+    if (*p == a || *p == b)
+      return p;
+  }
+  return end;
+}
+
+} // namespace
+
+const char* find_ctl_or(const char* begin, const char* end, char extra)
+{
+#if defined(HTTP_SERVER_SIMD_X86)
+  return find_sse2(begin, end, extra);
+#else
+  return find_scalar(begin, end, extra);
+#endif // defined(HTTP_SERVER_SIMD_X86)
+}
+
+const char* find_either(const char* begin, const char* end, char a, char b)
+{
+#if defined(HTTP_SERVER_SIMD_X86)
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  while (end - begin >= 16)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+    if (mask != 0)
+      return begin + __builtin_ctz(static_cast<unsigned>(mask));
+    begin += 16;
+  }
+#endif // defined(HTTP_SERVER_SIMD_X86)
+  return find_either_scalar(begin, end, a, b);
+}
+
+} // namespace char_scan
+} // namespace server
+} // namespace http
@@ -0,0 +1,30 @@
+//
+// char_scan.hpp
+// ~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_CHAR_SCAN_HPP
+#define HTTP_CHAR_SCAN_HPP
+
+namespace http {
+namespace server {
+namespace char_scan {
+
+/// Find the first byte in [begin, end) that is an HTTP control character
+/// (0-31 or 127) or equal to extra. Returns end if there is none. Uses SSE2
+/// where the target has it; most fields are shorter than an AVX2 register, and
+/// an AVX2 dispatch measured no faster on short requests.
+const char* find_ctl_or(const char* begin, const char* end, char extra);
+
+/// Find the first byte in [begin, end) equal to a or b. Returns end if there
+/// is none. Uses SSE2 where the target has it.
+const char* find_either(const char* begin, const char* end, char a, char b);
+
+} // namespace char_scan
+} // namespace server
+} // namespace http
+
+#endif // HTTP_CHAR_SCAN_HPP
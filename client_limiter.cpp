@@ -0,0 +1,38 @@
+//
+// client_limiter.cpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "client_limiter.hpp"
+
+namespace http {
+namespace server {
+
+client_limiter::client_limiter(std::size_t max_per_client)
+  : max_per_client_(max_per_client)
+{
+}
+
+bool client_limiter::acquire(const asio::ip::address& client)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::size_t& count = counts_[client];
+  if (count >= max_per_client_)
+    return false;
+  ++count;
+  return true;
+}
+
+void client_limiter::release(const asio::ip::address& client)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto i = counts_.find(client);
+  if (i != counts_.end() && --i->second == 0)
+    counts_.erase(i);
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,48 @@
+//
+// client_limiter.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_CLIENT_LIMITER_HPP
+#define HTTP_CLIENT_LIMITER_HPP
+
+#include <asio.hpp>
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+namespace http {
+namespace server {
+
+/// Counts the open connections of each client address to cap them. Shared by
+/// all shards, since the kernel spreads one client's connections over them;
+/// it is only touched when a connection is accepted or closed.
+class client_limiter
+{
+public:
+  client_limiter(const client_limiter&) = delete;
+  client_limiter& operator=(const client_limiter&) = delete;
+
+  /// Construct a limiter allowing max_per_client connections per address.
+  explicit client_limiter(std::size_t max_per_client);
+
+  /// Count a new connection from client. Returns false, counting nothing,
+  /// if the client already has as many as allowed.
+  bool acquire(const asio::ip::address& client);
+
+  /// Count a connection from client as closed.
+  void release(const asio::ip::address& client);
+
+private:
+  std::mutex mutex_;
+  std::size_t max_per_client_;
+  std::map<asio::ip::address, std::size_t> counts_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_CLIENT_LIMITER_HPP
@@ -0,0 +1,237 @@
+//
+// compression.cpp
+// ~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "compression.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <boost/algorithm/string.hpp>
+#if defined(HTTP_SERVER_WITH_ZLIB)
+#include <zlib.h>
+#endif // defined(HTTP_SERVER_WITH_ZLIB)
+#if defined(HTTP_SERVER_WITH_BROTLI)
+#include <brotli/encode.h>
+#endif // defined(HTTP_SERVER_WITH_BROTLI)
+#if defined(HTTP_SERVER_WITH_ZSTD)
+#include <zstd.h>
+#endif // defined(HTTP_SERVER_WITH_ZSTD)
+
+namespace http {
+namespace server {
+namespace compression {
+
+namespace {
+
+/// Preference between encodings with the same q-value; higher is better.
+int preference(encoding e)
+{
+  switch (e)
+  {
+  case brotli:
+    return 3;
+  case zstd:
+    return 2;
+  case gzip:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+std::string_view trim(std::string_view s)
+{
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+    s.remove_prefix(1);
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+    s.remove_suffix(1);
+  return s;
+}
+
+#if defined(HTTP_SERVER_WITH_ZLIB)
+bool compress_gzip(std::string_view in, std::string& out, effort level)
+{
+  z_stream zs = z_stream();
+  // 15 window bits plus 16 selects the gzip wrapper.
+  if (deflateInit2(&zs, level == best ? Z_BEST_COMPRESSION : 6, Z_DEFLATED,
+        15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+  out.resize(deflateBound(&zs, static_cast<uLong>(in.size())));
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+  zs.avail_in = static_cast<uInt>(in.size());
+  zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  zs.avail_out = static_cast<uInt>(out.size());
+  int result = deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return result == Z_STREAM_END;
+}
+#endif // defined(HTTP_SERVER_WITH_ZLIB)
+
+#if defined(HTTP_SERVER_WITH_BROTLI)
+bool compress_brotli(std::string_view in, std::string& out, effort level)
+{
+  std::size_t size = BrotliEncoderMaxCompressedSize(in.size());
+  if (size == 0)
+    return false;
+  out.resize(size);
+  if (!BrotliEncoderCompress(level == best ? 9 : 4, BROTLI_DEFAULT_WINDOW,
+        BROTLI_MODE_TEXT, in.size(),
+        reinterpret_cast<const uint8_t*>(in.data()), &size,
+        reinterpret_cast<uint8_t*>(&out[0])))
+    return false;
+  out.resize(size);
+  return true;
+}
+#endif // defined(HTTP_SERVER_WITH_BROTLI)
+
+#if defined(HTTP_SERVER_WITH_ZSTD)
+bool compress_zstd(std::string_view in, std::string& out, effort level)
+{
+  out.resize(ZSTD_compressBound(in.size()));
+  std::size_t size = ZSTD_compress(&out[0], out.size(), in.data(), in.size(),
+      level == best ? 12 : 3);
+  if (ZSTD_isError(size))
+    return false;
+  out.resize(size);
+  return true;
+}
+#endif // defined(HTTP_SERVER_WITH_ZSTD)
+
+} // namespace
+
+const char* content_encoding(encoding e)
+{
+  switch (e)
+  {
+  case gzip:
+    return "gzip";
+  case brotli:
+    return "br";
+  case zstd:
+    return "zstd";
+  default:
+    return "identity";
+  }
+}
+
+const char* file_extension(encoding e)
+{
+  switch (e)
+  {
+  case gzip:
+    return ".gz";
+  case brotli:
+    return ".br";
+  case zstd:
+    return ".zst";
+  default:
+    return "";
+  }
+}
+
+bool available(encoding e)
+{
+  switch (e)
+  {
+#if defined(HTTP_SERVER_WITH_ZLIB)
+  case gzip:
+    return true;
+#endif // defined(HTTP_SERVER_WITH_ZLIB)
+#if defined(HTTP_SERVER_WITH_BROTLI)
+  case brotli:
+    return true;
+#endif // defined(HTTP_SERVER_WITH_BROTLI)
+#if defined(HTTP_SERVER_WITH_ZSTD)
+  case zstd:
+    return true;
+#endif // defined(HTTP_SERVER_WITH_ZSTD)
+  default:
+    return false;
+  }
+}
+
+std::size_t negotiate(std::string_view accept_encoding, encoding* out)
+{
+  // q-values in thousandths; -1 means not mentioned.
+  int q[encoding_count] = { -1, -1, -1, -1 };
+  int wildcard = -1;
+
+  while (!accept_encoding.empty())
+  {
+    std::size_t comma = accept_encoding.find(',');
+    std::string_view item = accept_encoding.substr(0, comma);
+    accept_encoding.remove_prefix(
+        comma == std::string_view::npos ? accept_encoding.size() : comma + 1);
+
+    std::size_t semicolon = item.find(';');
+    std::string_view coding = trim(item.substr(0, semicolon));
+    int value = 1000;
+    if (semicolon != std::string_view::npos)
+    {
+      std::string_view param = trim(item.substr(semicolon + 1));
+      if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q')
+          && param[1] == '=')
+      {
+        std::string number(param.substr(2));
+        value = static_cast<int>(std::strtod(number.c_str(), nullptr) * 1000);
+      }
+    }
+
+    if (boost::algorithm::iequals(coding, "gzip")
+        || boost::algorithm::iequals(coding, "x-gzip"))
+      q[gzip] = value;
+    else if (boost::algorithm::iequals(coding, "br"))
+      q[brotli] = value;
+    else if (boost::algorithm::iequals(coding, "zstd"))
+      q[zstd] = value;
+    else if (coding == "*")
+      wildcard = value;
+  }
+
+  std::size_t count = 0;
+  for (int e = gzip; e < encoding_count; ++e)
+  {
+    if (q[e] < 0)
+      q[e] = wildcard;
+    if (q[e] > 0)
+      out[count++] = static_cast<encoding>(e);
+  }
+  std::sort(out, out + count,
+      [&q](encoding a, encoding b)
+      {
+        return q[a] != q[b] ? q[a] > q[b] : preference(a) > preference(b);
+      });
+  return count;
+}
+
+bool compress(encoding e, std::string_view in, std::string& out, effort level)
+{
+  switch (e)
+  {
+#if defined(HTTP_SERVER_WITH_ZLIB)
+  case gzip:
+    return compress_gzip(in, out, level);
+#endif // defined(HTTP_SERVER_WITH_ZLIB)
+#if defined(HTTP_SERVER_WITH_BROTLI)
+  case brotli:
+    return compress_brotli(in, out, level);
+#endif // defined(HTTP_SERVER_WITH_BROTLI)
+#if defined(HTTP_SERVER_WITH_ZSTD)
+  case zstd:
+    return compress_zstd(in, out, level);
+#endif // defined(HTTP_SERVER_WITH_ZSTD)
+  default:
+    (void)in;
+    (void)out;
+    (void)level;
+    return false;
+  }
+}
+
+} // namespace compression
+} // namespace server
+} // namespace http
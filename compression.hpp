@@ -0,0 +1,63 @@
+//
+// compression.hpp
+// ~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_COMPRESSION_HPP
+#define HTTP_COMPRESSION_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace http {
+namespace server {
+namespace compression {
+
+/// Content codings understood by the server. On-the-fly compression needs the
+/// matching library, enabled with HTTP_SERVER_WITH_ZLIB, HTTP_SERVER_WITH_BROTLI
+/// and HTTP_SERVER_WITH_ZSTD. Precompressed files are served without them.
+enum encoding
+{
+  identity = 0,
+  gzip,
+  brotli,
+  zstd,
+  encoding_count
+};
+
+/// How hard to try: fast for replies compressed on every request, best for
+/// results that are cached and reused.
+enum effort
+{
+  fast,
+  best
+};
+
+/// The Content-Encoding header value for an encoding.
+const char* content_encoding(encoding e);
+
+/// The extension of precompressed sidecar files, e.g. ".gz".
+const char* file_extension(encoding e);
+
+/// Whether this build can compress with the given encoding.
+bool available(encoding e);
+
+/// Parse an Accept-Encoding header value. Writes the acceptable encodings to
+/// out, best first (by q-value, then br, zstd, gzip), and returns how many
+/// were written; out must have room for encoding_count entries.
+std::size_t negotiate(std::string_view accept_encoding, encoding* out);
+
+/// Compress in into out. Returns false if the encoding is not available or
+/// compression failed.
+bool compress(encoding e, std::string_view in, std::string& out,
+    effort level = fast);
+
+} // namespace compression
+} // namespace server
+} // namespace http
+
+#endif // HTTP_COMPRESSION_HPP
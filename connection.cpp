@@ -9,9 +9,17 @@
 //
 
 #include "connection.hpp"
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif // defined(__linux__)
 #include <utility>
 #include <vector>
-#include <regex>
 #include "connection_manager.hpp"
 #include "request_handler.hpp"
 #include <boost/algorithm/string.hpp>
@@ -20,142 +28,813 @@ namespace http {
 namespace server {
 
 connection::connection(asio::ip::tcp::socket socket,
-    connection_manager& manager, request_handler& handler)
+    connection_manager& manager, request_handler& handler,
+    timer_wheel& timers, const options& opts)
   : socket_(std::move(socket)),
     connection_manager_(manager),
-    request_handler_(handler)
+    metrics_(manager.metrics()),
+    request_handler_(handler),
+    timer_wheel_(timers),
+    options_(opts),
+    arena_(arena_buffer_.data(), arena_buffer_.size(),
+        std::pmr::new_delete_resource()),
+    request_(&arena_)
 {
+  timeout_.callback = [this]() { handle_timeout(); };
 }
 
 void connection::start()
 {
+  // Replies are written whole, so Nagle's algorithm has nothing to combine;
+  // it would only hold back the end of a write asio splits, until the client
+  // acknowledges the start of it.
+  asio::error_code ignored_ec;
+  socket_.set_option(asio::ip::tcp::no_delay(true), ignored_ec);
   do_read();
 }
 
 void connection::stop()
 {
+  set_timeout(timeout_phase::none);
   socket_.close();
 }
 
+void connection::restart(asio::ip::tcp::socket socket)
+{
+  socket_ = std::move(socket);
+  buffered_ = 0;
+  oversized_ = false;
+  replies_.clear();
+  write_index_ = 0;
+  file_offset_ = 0;
+  chunk_ = std::string();
+  chunk_header_.clear();
+  stream_resume_ = body_resume();
+  stream_paused_ = false;
+  watching_ = false;
+  keep_alive_ = false;
+  closing_ = false;
+  waiting_ = false;
+  writing_ = false;
+  requests_served_ = 0;
+  reset();
+}
+
 void connection::do_read()
 {
+  // The header deadline runs from the first byte of the request, and the
+  // body rate is measured over whole periods, so a read restarts neither.
+  if (receiving_)
+  {
+    if (timeout_phase_ != timeout_phase::body)
+      set_timeout(timeout_phase::body);
+  }
+  else if (buffered_ != 0 || oversized_)
+  {
+    if (timeout_phase_ != timeout_phase::header)
+      set_timeout(timeout_phase::header);
+  }
+  else
+  {
+    set_timeout(timeout_phase::idle);
+  }
+
   auto self(shared_from_this());
-  socket_.async_read_some(asio::buffer(buffer_),
+  socket_.async_read_some(
+      asio::buffer(buffer_.data() + buffered_, buffer_.size() - buffered_),
       [this, self](std::error_code ec, std::size_t bytes_transferred)
       {
         if (!ec)
         {
-          request_parser::result_type result;
-          std::tie(result, std::ignore) = request_parser_.parse(
-              request_, buffer_.data(), buffer_.data() + bytes_transferred);
-
-          /**
-           * @brief 数据接收处理说明
-           * @author liyang
-           * @details 如果是get请求，原代码没有问题;如果是post请求，这个就只能接收第一次请求需要改造
-           *          因为get请求是一次tcp 而post请求可能需要多次tcp.
-           *          当body数据超长时调用doread方法读取数据.
-           */
-          std::string http_data = buffer_.data();
-          // 如果buffer_数据填满，赋值后http_data尾部存在乱码，需要将多余数据摘除
-          // buffer_ 的max_size() 和 size()获取长度一致
-          if(http_data.size() > buffer_.max_size()) http_data.resize(buffer_.max_size());
-          // 获取完数据一定要清空
-          buffer_ ={'\0'};
-          if(!receiving_)
-          {
-              receiving_ =true;//开始接收数据
-              request_first = request_;
-              result_first = result;
-              if("POST" == request_first.method)
-              {
-                  // 获取header长度(加上结束符)
-                  size_t header_length = http_data.find("\r\n\r\n") +4;
-                  // 获取content长度
-                  content_length_ = 0;
-                  for(auto head :request_first.headers)
-                  {
-                      if(boost::algorithm::iequals(head.name,"Content-Length"))
-                      {
-                          content_length_ = atoi(head.value.data());
-                          break;
-                      }
-                  }
-                  // 如果存在内容则拷贝
-                  if(http_data.size() > header_length)
-                  {
-                      request_first.content =http_data.substr(header_length,http_data.size()-header_length);
-                  }
-                  // 内容未拷贝完则再次读取
-                  if(content_length_ > request_first.content.size())
-                  {
-                      do_read();
-                      return;
-                  }
-              }
-          }
-          else
-          {
-              if("POST" == request_first.method
-                      && content_length_ > request_first.content.size())
-              {
-                  // 拷贝内容
-                  request_first.content.append(http_data.data(),http_data.size());
-                  if(http_data.size() == buffer_.max_size()
-                          && content_length_ > request_first.content.size())
-                  {
-                      do_read();
-                      return;
-                  }
-              }
-          }
-
-          if (result_first == request_parser::good)
-          {
-              receiving_ = false;
-              request_parser_.parse_param(request_first);
-              request_handler_.handle_request(request_first, reply_);
-              do_write();
-          }
-          else if (result_first == request_parser::bad)
-          {
-              receiving_ = false;
-              reply_ = reply::stock_reply(reply::bad_request);
-              do_write();
-          }
-          else
-          {
-              receiving_ = false;
-              do_read();
-          }
+          metrics_.bytes_received.add(bytes_transferred);
+          std::size_t size = buffered_ + bytes_transferred;
+          buffered_ = 0;
+          handle_data(buffer_.data(), buffer_.data() + size);
         }
         else if (ec != asio::error::operation_aborted)
         {
-            receiving_ = false;
-            connection_manager_.stop(shared_from_this());
+          connection_manager_.stop(shared_from_this());
         }
       });
 }
 
+void connection::handle_data(const char* begin, const char* end)
+{
+  /**
+   * @brief 数据接收处理说明
+   * @details 一次读取可能包含多个请求(pipelining)，也可能只包含请求的一部分。
+   *          请求头完整时直接在buffer_上解析(不拷贝)，不完整时把剩余数据移到
+   *          buffer_头部等待后续数据。请求头解析完后按Content-Length接收body，
+   *          剩余数据继续解析下一个请求。缓冲区中所有完整请求的响应一次性写出。
+   */
+  while (begin != end && !closing_ && !waiting_)
+  {
+    if (receiving_)
+    {
+      std::size_t wanted = content_length_ - body_received_;
+      std::size_t available = static_cast<std::size_t>(end - begin);
+      std::size_t n = wanted < available ? wanted : available;
+      if (body_reader_)
+        body_reader_(std::string_view(begin, n));
+      else
+        body_.append(begin, n);
+      body_received_ += n;
+      begin += n;
+      if (body_received_ < content_length_)
+        break;
+      receiving_ = false;
+      request_view_.content = body_;
+      complete_request();
+      continue;
+    }
+
+    request_parser::result_type result;
+    auto parse_start = std::chrono::steady_clock::now();
+    if (oversized_)
+    {
+      const char* start = begin;
+      std::tie(result, begin) = request_parser_.parse(request_, begin, end);
+      header_bytes_ += static_cast<std::size_t>(begin - start);
+      if (result != request_parser::bad && options_.max_header_bytes != 0
+          && header_bytes_ > options_.max_header_bytes)
+      {
+        oversized_ = false;
+        reject_request(reply::request_header_fields_too_large);
+      }
+      else if (result == request_parser::good)
+      {
+        metrics_.parse_time.record(
+            std::chrono::steady_clock::now() - parse_start);
+        oversized_ = false;
+        request_view_.assign(request_);
+        begin = start_body(begin, end);
+      }
+      else if (result == request_parser::bad)
+      {
+        reject_request(reply::bad_request);
+      }
+      continue;
+    }
+
+    const char* next;
+    std::tie(result, next) =
+      request_parser_.parse(request_view_, request_, begin, end);
+    if (result == request_parser::good && options_.max_header_bytes != 0
+        && static_cast<std::size_t>(next - begin) > options_.max_header_bytes)
+    {
+      reject_request(reply::request_header_fields_too_large);
+    }
+    else if (result == request_parser::good)
+    {
+      metrics_.parse_time.record(
+          std::chrono::steady_clock::now() - parse_start);
+      begin = start_body(next, end);
+    }
+    else if (result == request_parser::bad)
+    {
+      reject_request(reply::bad_request);
+    }
+    else
+    {
+      std::size_t size = static_cast<std::size_t>(end - begin);
+      if (size == buffer_.size() && options_.max_header_bytes != 0
+          && size >= options_.max_header_bytes)
+      {
+        reject_request(reply::request_header_fields_too_large);
+        break;
+      }
+      else if (size == buffer_.size())
+      {
+        // The header does not fit into the buffer; stream it through the
+        // state machine into request_ instead, up to max_header_bytes.
+        oversized_ = true;
+        header_bytes_ = 0;
+        request_ = pmr::request(&arena_);
+        request_parser_.reset();
+        continue;
+      }
+
+      // Keep the partial header at the front of the buffer and read the rest
+      // behind it.
+      if (begin != buffer_.data())
+        std::memmove(buffer_.data(), begin, size);
+      buffered_ = size;
+      break;
+    }
+  }
+
+  if (waiting_ && begin != end)
+  {
+    // Pipelined requests behind a deferred reply wait at the front of the
+    // buffer until it has been sent.
+    std::size_t size = static_cast<std::size_t>(end - begin);
+    if (begin != buffer_.data())
+      std::memmove(buffer_.data(), begin, size);
+    buffered_ = size;
+  }
+
+  if (!replies_.empty())
+    do_write();
+  else if (!waiting_)
+    do_read();
+}
+
+const char* connection::start_body(const char* begin, const char* end)
+{
+  content_length_ = 0;
+  bool valid = true;
+  bool chunked = false;
+  if (const header_view* h =
+        request_view_.find_header(header_content_length))
+  {
+    std::string value(h->value);
+    char* length_end = nullptr;
+    content_length_ = std::strtoull(value.c_str(), &length_end, 10);
+    valid = !value.empty() && *length_end == '\0'
+      && std::isdigit(static_cast<unsigned char>(value[0]));
+  }
+  if (request_view_.find_header(header_transfer_encoding))
+    chunked = true;
+  if (!valid)
+  {
+    reject_request(reply::bad_request);
+    return end;
+  }
+  if (chunked)
+  {
+    // Chunked request bodies are not supported; without a length the end of
+    // the request cannot be found.
+    reject_request(reply::not_implemented);
+    return end;
+  }
+
+  if (content_length_ != 0)
+    body_reader_ = request_handler_.open_body(request_view_);
+  if (!body_reader_ && options_.max_request_body_bytes != 0
+      && content_length_ > options_.max_request_body_bytes)
+  {
+    reject_request(reply::payload_too_large);
+    return end;
+  }
+
+  std::size_t available = static_cast<std::size_t>(end - begin);
+  if (content_length_ <= available)
+  {
+    const char* body_end = begin + content_length_;
+    if (body_reader_)
+      body_reader_(std::string_view(begin, content_length_));
+    else
+      request_view_.content = std::string_view(begin, content_length_);
+    complete_request();
+    return body_end;
+  }
+
+  // The body continues in later reads, which reuse buffer_, so the header
+  // must stop referring to it. A streamed body is passed on as it arrives;
+  // otherwise it is collected in body_, whose size is known and bounded.
+  request_view_.keep(request_);
+  if (body_reader_)
+  {
+    body_reader_(std::string_view(begin, available));
+  }
+  else
+  {
+    body_.reserve(content_length_);
+    body_.assign(begin, available);
+  }
+  body_received_ = available;
+  receiving_ = true;
+  return end;
+}
+
+void connection::complete_request()
+{
+  handle_start_ = std::chrono::steady_clock::now();
+  replies_.emplace_back();
+  reply& rep = replies_.back();
+  // A body collected over several reads is handed over rather than copied.
+  bool owned_body = !body_reader_ && body_received_ != 0;
+  bool done = request_handler_.handle_request(request_view_, rep,
+      owned_body ? &body_ : nullptr,
+      [this]() -> responder::deliver_function
+      {
+        std::weak_ptr<connection> weak(shared_from_this());
+        connection_id id = id_;
+        return [weak, id](reply&& deferred)
+          {
+            auto self = weak.lock();
+            if (self && self->id_ == id)
+              self->complete_deferred(std::move(deferred));
+          };
+      });
+  if (!done)
+  {
+    // The reply comes later. The header is still needed by prepare_reply()
+    // then, but buffer_ will be reused, so keep a copy.
+    replies_.pop_back();
+    request_view_.content = std::string_view();
+    request_view_.keep(request_);
+    waiting_ = true;
+    if (!writing_)
+      set_timeout(timeout_phase::handler);
+    watch_peer();
+    return;
+  }
+  metrics_.handle_time.record(std::chrono::steady_clock::now() - handle_start_);
+  prepare_reply(request_view_, rep, true);
+  if (!keep_alive_)
+    closing_ = true;
+  reset();
+}
+
+void connection::complete_deferred(reply&& rep)
+{
+  // A reply given up on by handle_timeout() is dropped.
+  if (!socket_.is_open() || !waiting_)
+    return;
+
+  metrics_.handle_time.record(std::chrono::steady_clock::now() - handle_start_);
+  replies_.push_back(std::move(rep));
+  prepare_reply(request_view_, replies_.back(), true);
+  if (!keep_alive_)
+    closing_ = true;
+  reset();
+  waiting_ = false;
+
+  // Replies to earlier requests may still be being written, in which case
+  // this one is picked up once they are done.
+  if (!writing_)
+    do_write();
+}
+
+void connection::reject_request(reply::status_type status)
+{
+  replies_.push_back(reply::stock_reply(status));
+  prepare_reply(request_view_, replies_.back(), false);
+  closing_ = true;
+  reset();
+}
+
+void connection::watch_peer()
+{
+  if (watching_ || !waiting_ || buffered_ == buffer_.size())
+    return;
+
+  // Only wait for readability and then read without blocking, so that no
+  // read into buffer_ is outstanding once the deferred reply arrives.
+  watching_ = true;
+  auto self(shared_from_this());
+  socket_.async_wait(asio::ip::tcp::socket::wait_read,
+      [this, self](std::error_code ec)
+      {
+        watching_ = false;
+        if (ec || !waiting_)
+          return;
+
+        asio::error_code read_ec;
+        socket_.non_blocking(true, read_ec);
+        std::size_t n = socket_.read_some(
+            asio::buffer(buffer_.data() + buffered_,
+              buffer_.size() - buffered_), read_ec);
+        if (read_ec && read_ec != asio::error::would_block)
+        {
+          connection_manager_.stop(shared_from_this());
+          return;
+        }
+        metrics_.bytes_received.add(n);
+        buffered_ += n;
+        watch_peer();
+      });
+}
+
 void connection::do_write()
 {
+  // Gather the queued replies into one write, up to and including the next
+  // reply with a file or streamed body, which is then sent on its own. The
+  // headers are serialised first, into one block, so that each reply takes
+  // at most three buffers: its header, content and shared content.
+  if (!writing_)
+    write_start_ = std::chrono::steady_clock::now();
+  writing_ = true;
+  write_header_.clear();
+  header_ends_.clear();
+  std::size_t next = write_index_;
+  while (next < replies_.size())
+  {
+    reply& rep = replies_[next++];
+    rep.serialize_header(write_header_);
+    header_ends_.push_back(write_header_.size());
+    if (rep.file || rep.producer)
+      break;
+  }
+
+  write_buffers_.clear();
+  std::size_t header_start = 0;
+  for (std::size_t i = write_index_; i < next; ++i)
+  {
+    std::size_t header_end = header_ends_[i - write_index_];
+    write_buffers_.push_back(asio::buffer(write_header_.data() + header_start,
+          header_end - header_start));
+    replies_[i].body_to_buffers(write_buffers_);
+    header_start = header_end;
+  }
+
+  set_timeout(timeout_phase::write);
   auto self(shared_from_this());
-  asio::async_write(socket_, reply_.to_buffers(),
-      [this, self](std::error_code ec, std::size_t)
+  asio::async_write(socket_, write_buffers_,
+      [this, self, next](std::error_code ec, std::size_t bytes_transferred)
       {
-        if (!ec)
+        if (ec)
         {
-          // Initiate graceful connection closure.
-          asio::error_code ignored_ec;
-          socket_.shutdown(asio::ip::tcp::socket::shutdown_both,
-            ignored_ec);
+          if (ec != asio::error::operation_aborted)
+            connection_manager_.stop(shared_from_this());
+          return;
         }
 
-        if (ec != asio::error::operation_aborted)
+        metrics_.bytes_sent.add(bytes_transferred);
+        write_index_ = next;
+        file_offset_ = 0;
+        if (replies_[next - 1].file)
+          do_write_file();
+        else if (replies_[next - 1].producer)
+          do_write_stream();
+        else
+          finish_write();
+      });
+}
+
+void connection::do_write_file()
+{
+  file_body& file = *replies_[write_index_ - 1].file;
+#if defined(__linux__)
+  // Send straight from the page cache to the socket. The socket is switched
+  // to non-blocking mode so that sendfile() returns EAGAIN instead of
+  // blocking, and the io_context tells us when to try again.
+  asio::error_code ec;
+  if (!socket_.native_non_blocking())
+    socket_.native_non_blocking(true, ec);
+  while (!ec && file_offset_ < file.size)
+  {
+    off_t offset = static_cast<off_t>(file_offset_);
+    ssize_t n = ::sendfile(socket_.native_handle(), file.fd, &offset,
+        file.size - file_offset_);
+    if (n > 0)
+    {
+      file_offset_ += static_cast<std::size_t>(n);
+      metrics_.bytes_sent.add(static_cast<std::size_t>(n));
+    }
+    else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      set_timeout(timeout_phase::write);
+      auto self(shared_from_this());
+      socket_.async_wait(asio::ip::tcp::socket::wait_write,
+          [this, self](std::error_code wait_ec)
+          {
+            if (!wait_ec)
+              do_write_file();
+            else if (wait_ec != asio::error::operation_aborted)
+              connection_manager_.stop(shared_from_this());
+          });
+      return;
+    }
+    else if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    else
+    {
+      // The file shrank after its size was sent, or the socket failed; the
+      // reply cannot be completed.
+      ec = asio::error_code(n < 0 ? errno : EIO,
+          asio::error::get_system_category());
+    }
+  }
+  if (ec)
+  {
+    connection_manager_.stop(shared_from_this());
+    return;
+  }
+  finish_write();
+#else
+  // Without sendfile() the file goes through a fixed-size buffer, so memory
+  // use still does not depend on the file size.
+  if (file_offset_ == file.size)
+  {
+    finish_write();
+    return;
+  }
+  std::size_t wanted = file.size - file_offset_;
+  if (wanted > file_buffer_.size())
+    wanted = file_buffer_.size();
+  ssize_t n = ::pread(file.fd, file_buffer_.data(), wanted,
+      static_cast<off_t>(file_offset_));
+  if (n <= 0)
+  {
+    connection_manager_.stop(shared_from_this());
+    return;
+  }
+  set_timeout(timeout_phase::write);
+  auto self(shared_from_this());
+  asio::async_write(socket_,
+      asio::buffer(file_buffer_.data(), static_cast<std::size_t>(n)),
+      [this, self](std::error_code ec, std::size_t bytes_transferred)
+      {
+        if (!ec)
+        {
+          metrics_.bytes_sent.add(bytes_transferred);
+          file_offset_ += bytes_transferred;
+          do_write_file();
+        }
+        else if (ec != asio::error::operation_aborted)
         {
           connection_manager_.stop(shared_from_this());
         }
       });
+#endif // defined(__linux__)
+}
+
+void connection::do_write_stream()
+{
+  static const char crlf[] = { '\r', '\n' };
+  static const char last_chunk[] = { '0', '\r', '\n', '\r', '\n' };
+
+  reply& rep = replies_[write_index_ - 1];
+  if (!stream_resume_)
+  {
+    std::weak_ptr<connection> weak(shared_from_this());
+    connection_id id = id_;
+    auto executor = socket_.get_executor();
+    stream_resume_ = [weak, id, executor]()
+      {
+        asio::post(executor,
+            [weak, id]()
+            {
+              auto self = weak.lock();
+              if (self && self->id_ == id)
+                self->resume_stream();
+            });
+      };
+  }
+  chunk_.clear();
+  bool more = rep.producer(chunk_, stream_resume_);
+
+  write_buffers_.clear();
+  if (!chunk_.empty())
+  {
+    if (rep.chunked)
+    {
+      char size[24];
+      int n = std::snprintf(size, sizeof(size), "%zx\r\n", chunk_.size());
+      chunk_header_.assign(size, static_cast<std::size_t>(n));
+      write_buffers_.push_back(asio::buffer(chunk_header_));
+      write_buffers_.push_back(asio::buffer(chunk_));
+      write_buffers_.push_back(asio::buffer(crlf));
+    }
+    else
+    {
+      write_buffers_.push_back(asio::buffer(chunk_));
+    }
+  }
+  if (!more && rep.chunked)
+    write_buffers_.push_back(asio::buffer(last_chunk));
+
+  if (write_buffers_.empty())
+  {
+    // The producer has nothing yet. Wait for it to call resume, but no
+    // longer than a client that stopped reading would be given.
+    if (more)
+    {
+      stream_paused_ = true;
+      set_timeout(timeout_phase::write);
+    }
+    else
+    {
+      finish_write();
+    }
+    return;
+  }
+
+  // The producer is only asked for more once this piece has been written, so
+  // a slow client slows the producer down instead of piling up memory.
+  set_timeout(timeout_phase::write);
+  auto self(shared_from_this());
+  asio::async_write(socket_, write_buffers_,
+      [this, self, more](std::error_code ec, std::size_t bytes_transferred)
+      {
+        if (ec)
+        {
+          if (ec != asio::error::operation_aborted)
+            connection_manager_.stop(shared_from_this());
+          return;
+        }
+
+        metrics_.bytes_sent.add(bytes_transferred);
+        if (more)
+          do_write_stream();
+        else
+          finish_write();
+      });
+}
+
+void connection::resume_stream()
+{
+  if (!stream_paused_ || !socket_.is_open())
+    return;
+  stream_paused_ = false;
+  do_write_stream();
+}
+
+void connection::finish_write()
+{
+  if (stream_resume_)
+    stream_resume_ = body_resume();
+  if (write_index_ < replies_.size())
+  {
+    do_write();
+    return;
+  }
+
+  write_index_ = 0;
+  replies_.clear();
+  writing_ = false;
+  metrics_.write_time.record(std::chrono::steady_clock::now() - write_start_);
+  if (waiting_)
+  {
+    // A deferred reply is outstanding; it restarts writing when it arrives.
+    set_timeout(timeout_phase::handler);
+    watch_peer();
+    return;
+  }
+  if (!closing_)
+  {
+    // Continue with the next request on the same connection. Data left in
+    // buffer_, a partial header or requests held back behind a deferred
+    // reply, is handled first; a partially received request continues
+    // where it stopped.
+    std::size_t size = buffered_;
+    buffered_ = 0;
+    handle_data(buffer_.data(), buffer_.data() + size);
+    return;
+  }
+
+  // Initiate graceful connection closure.
+  asio::error_code ignored_ec;
+  socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ignored_ec);
+  connection_manager_.stop(shared_from_this());
+}
+
+void connection::prepare_reply(const request_view& req, reply& rep,
+    bool valid)
+{
+  ++requests_served_;
+  metrics_.requests.add();
+  int status_class = static_cast<int>(rep.status) / 100;
+  if (status_class >= 1 && status_class <= 5)
+    metrics_.replies[status_class - 1].add();
+
+  // HTTP/1.1 connections are persistent unless the client asks otherwise,
+  // HTTP/1.0 connections only when the client explicitly asks for it.
+  const header_view* connection_header = req.find_header(header_connection);
+  bool http_1_1 = req.http_version_major > 1
+    || (req.http_version_major == 1 && req.http_version_minor >= 1);
+  if (connection_header)
+  {
+    std::string_view value = connection_header->value;
+    keep_alive_ = http_1_1
+      ? !boost::algorithm::icontains(value, "close")
+      : boost::algorithm::icontains(value, "keep-alive");
+  }
+  else
+  {
+    keep_alive_ = http_1_1;
+  }
+
+  if (!valid || !options_.keep_alive)
+    keep_alive_ = false;
+  if (options_.max_keep_alive_requests != 0
+      && requests_served_ >= options_.max_keep_alive_requests)
+    keep_alive_ = false;
+
+  rep.detach_stock();
+
+  // A streamed body has no length. HTTP/1.1 clients get it chunked; for
+  // older clients closing the connection marks its end.
+  if (rep.producer)
+  {
+    rep.chunked = http_1_1;
+    if (!rep.chunked)
+      keep_alive_ = false;
+    for (std::size_t i = rep.headers.size(); i-- > 0; )
+    {
+      if (header_name_equals(rep.headers[i].name, "Content-Length")
+          || header_name_equals(rep.headers[i].name, "Transfer-Encoding"))
+        rep.headers.erase(rep.headers.begin() + i);
+    }
+    if (rep.chunked)
+      rep.headers.push_back(header{"Transfer-Encoding", "chunked"});
+  }
+
+  // A persistent connection needs every reply to be delimited, so make sure
+  // Content-Length is present even when the callback replaced the reply. An
+  // unchanged stock reply has it in its prebuilt block.
+  bool has_content_length = rep.producer != nullptr || rep.stock != nullptr;
+  bool has_connection = false;
+  for (auto& h: rep.headers)
+  {
+    if (header_name_equals(h.name, "Content-Length"))
+    {
+      h.value = std::to_string(rep.body_size());
+      has_content_length = true;
+    }
+    else if (header_name_equals(h.name, "Connection"))
+    {
+      h.value = keep_alive_ ? "keep-alive" : "close";
+      has_connection = true;
+    }
+  }
+  if (!has_content_length)
+    rep.headers.push_back(
+        header{"Content-Length", std::to_string(rep.body_size())});
+  if (!has_connection)
+    rep.headers.push_back(
+        header{"Connection", keep_alive_ ? "keep-alive" : "close"});
+}
+
+void connection::reset()
+{
+  request_parser_.reset();
+  request_view_.clear();
+  body_ = std::string();
+  receiving_ = false;
+  content_length_ = 0;
+  body_received_ = 0;
+  body_reader_ = body_reader();
+
+  // Nothing refers to the arena any more, so start it afresh. The request is
+  // moved out rather than assigned over: assigning a short string keeps the
+  // buffer the old one had in the arena.
+  {
+    pmr::request discarded(std::move(request_));
+  }
+  request_ = pmr::request(&arena_);
+  arena_.release();
+}
+
+void connection::set_timeout(timeout_phase phase)
+{
+  std::chrono::milliseconds timeout(0);
+  switch (phase)
+  {
+  case timeout_phase::idle:
+    timeout = options_.idle_timeout;
+    break;
+  case timeout_phase::header:
+    timeout = options_.header_timeout;
+    break;
+  case timeout_phase::body:
+    timeout = options_.body_timeout;
+    body_mark_ = body_received_;
+    break;
+  case timeout_phase::write:
+    timeout = options_.write_timeout;
+    break;
+  case timeout_phase::handler:
+    timeout = options_.handler_timeout;
+    break;
+  case timeout_phase::none:
+    break;
+  }
+
+  timeout_phase_ = phase;
+  if (timeout.count() > 0)
+    timer_wheel_.schedule(timeout_, timeout);
+  else
+    timer_wheel_.cancel(timeout_);
+}
+
+void connection::handle_timeout()
+{
+  if (timeout_phase_ == timeout_phase::body)
+  {
+    // A body still arriving fast enough gets another period.
+    std::size_t wanted = static_cast<std::size_t>(
+        options_.body_min_rate * options_.body_timeout.count() / 1000);
+    if (body_received_ - body_mark_ >= (wanted != 0 ? wanted : 1))
+    {
+      set_timeout(timeout_phase::body);
+      return;
+    }
+  }
+  metrics_.connections_timed_out.add();
+  if (timeout_phase_ == timeout_phase::handler)
+  {
+    // Give up on the deferred reply, answer for it and close.
+    waiting_ = false;
+    reject_request(reply::gateway_timeout);
+    do_write();
+    return;
+  }
+  connection_manager_.stop(shared_from_this());
 }
 
 } // namespace server
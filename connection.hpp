@@ -12,20 +12,34 @@
 #define HTTP_CONNECTION_HPP
 
 #include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <memory_resource>
 #include <asio.hpp>
 #include <vector>
 #include <string>
+#include "metrics.hpp"
+#include "options.hpp"
 #include "reply.hpp"
 #include "request.hpp"
 #include "request_handler.hpp"
 #include "request_parser.hpp"
+#include "request_view.hpp"
+#include "timer_wheel.hpp"
 
 namespace http {
 namespace server {
 
 class connection_manager;
 
+/// Identifies a connection within its shard: the low half is a slot in the
+/// connection_manager, the high half the generation of that slot. Zero is
+/// never a valid id.
+typedef std::uint64_t connection_id;
+
 /// Represents a single connection from a client.
 class connection
   : public std::enable_shared_from_this<connection>
@@ -36,7 +50,8 @@ public:
 
   /// Construct a connection with the given socket.
   explicit connection(asio::ip::tcp::socket socket,
-      connection_manager& manager, request_handler& handler);
+      connection_manager& manager, request_handler& handler,
+      timer_wheel& timers, const options& opts);
 
   /// Start the first asynchronous operation for the connection.
   void start();
@@ -44,43 +59,221 @@ public:
   /// Stop all asynchronous operations associated with the connection.
   void stop();
 
+  /// Reuse a stopped connection, no longer referenced by any pending
+  /// operation, for a new socket. Buffers and their capacity are kept.
+  void restart(asio::ip::tcp::socket socket);
+
+  /// The id given to the connection when it was last started.
+  connection_id id() const { return id_; }
+
 private:
+  friend class connection_manager;
+
   /// Perform an asynchronous read operation.
   void do_read();
 
-  /// Perform an asynchronous write operation.
+  /// Perform an asynchronous write operation for the queued replies.
   void do_write();
 
+  /// Send the file body of the reply just written.
+  void do_write_file();
+
+  /// Pull the next piece of the streamed body of the reply just written and
+  /// send it.
+  void do_write_stream();
+
+  /// Continue a streamed body paused for want of data, if it still is.
+  void resume_stream();
+
+  /// Continue with the remaining replies, or read the next request once all
+  /// have been written.
+  void finish_write();
+
+  /// Consume received bytes. Every complete request found in the data is
+  /// handled and its reply queued, so pipelined requests are answered in one
+  /// write.
+  void handle_data(const char* begin, const char* end);
+
+  /// Called once a request header has been parsed into request_view_.
+  /// Takes the body from [begin, end) if it is all there and completes the
+  /// request, otherwise starts receiving it. Returns the position after
+  /// whatever was consumed.
+  const char* start_body(const char* begin, const char* end);
+
+  /// Handle the fully received request_view_ and queue its reply.
+  void complete_request();
+
+  /// Queue the reply to the deferred request, once the handler has it.
+  void complete_deferred(reply&& rep);
+
+  /// Queue a stock reply for an invalid request and stop reading.
+  void reject_request(reply::status_type status);
+
+  /// While a reply is deferred, take in whatever the client sends, to be
+  /// handled once the reply is sent, and stop the connection if the client
+  /// closes it.
+  void watch_peer();
+
+  /// Decide whether the connection stays open after the current request and
+  /// add the matching Connection and Content-Length headers to the reply.
+  void prepare_reply(const request_view& req, reply& rep, bool valid);
+
+  /// Clear the per-request state so the next request can be read on the same
+  /// connection.
+  void reset();
+
+  /// What the connection is waiting for, which decides its timeout.
+  enum class timeout_phase
+  {
+    none,
+    idle,
+    header,
+    body,
+    write,
+    handler
+  };
+
+  /// Start the timeout for a phase, replacing the current one.
+  void set_timeout(timeout_phase phase);
+
+  /// Called when the timeout of the current phase expires.
+  void handle_timeout();
+
   /// Socket for the connection.
   asio::ip::tcp::socket socket_;
 
   /// The manager for this connection.
   connection_manager& connection_manager_;
 
+  /// The metrics of the shard, from the manager.
+  shard_metrics& metrics_;
+
   /// The handler used to process the incoming request.
   request_handler& request_handler_;
 
+  /// The timer wheel of the shard, and this connection's entry in it.
+  timer_wheel& timer_wheel_;
+  timer_wheel::entry timeout_;
+
+  /// The phase timeout_ is scheduled for.
+  timeout_phase timeout_phase_ = timeout_phase::none;
+
+  /// body_received_ when the current body_timeout period started.
+  std::size_t body_mark_ = 0;
+
+  /// The server options.
+  const options& options_;
+
   /// Buffer for incoming data.
   std::array<char, 8192> buffer_;
 
-  /// The incoming request.
-  request request_;
+  /// Number of bytes at the start of buffer_ holding an incomplete request
+  /// header carried over from the previous read.
+  std::size_t buffered_ = 0;
+
+  /// Memory for the per-request data that cannot stay in buffer_. It is
+  /// used up monotonically and released between requests; allocations that
+  /// do not fit the initial block go to the global heap.
+  alignas(std::max_align_t) std::array<char, 4096> arena_buffer_;
+  std::pmr::monotonic_buffer_resource arena_;
+
+  /// The incoming request. Its fields refer into buffer_ whenever the whole
+  /// request arrived in one buffer, otherwise into request_ and body_.
+  request_view request_view_;
+
+  /// Header storage, allocated from arena_, for requests that cannot be
+  /// referenced in place: headers longer than the buffer, continuation
+  /// lines, bodies spanning several reads or deferred replies.
+  pmr::request request_;
+
+  /// A request body collected over several reads. Kept on the global heap
+  /// so that it can be handed to the callback without copying.
+  std::string body_;
+
+  /// Set while a header too large for buffer_ is fed to the state machine.
+  bool oversized_ = false;
+
+  /// Bytes of the oversized header fed to the state machine so far.
+  std::size_t header_bytes_ = 0;
 
   /// The parser for the incoming request.
   request_parser request_parser_;
 
-  /// The reply to be sent back to the client.
-  reply reply_;
+  /// The replies to be sent back to the client, in request order. A deque,
+  /// so that a deferred reply can be queued while earlier ones are being
+  /// written from it.
+  std::deque<reply> replies_;
+
+  /// Index of the first reply in replies_ not yet written.
+  std::size_t write_index_ = 0;
+
+  /// The headers of the replies being written, serialised one after the
+  /// other, where each ends, and the buffers of the write. Reused from one
+  /// write to the next, so that writing does not allocate.
+  std::string write_header_;
+  std::vector<std::size_t> header_ends_;
+  std::vector<asio::const_buffer> write_buffers_;
+
+  /// Number of bytes of the current file body already sent.
+  std::size_t file_offset_ = 0;
+
+  /// The piece of a streamed body being written, and its chunk header.
+  std::string chunk_;
+  std::string chunk_header_;
+
+  /// Passed to the producer of a streamed body to wake it from stream_paused_.
+  /// Made once per streamed reply.
+  body_resume stream_resume_;
+
+  /// Set while the producer of a streamed body has nothing to send.
+  bool stream_paused_ = false;
 
-  /// liyang add some variables for post method
-  /// 第一次的请求
-  request request_first;
-  /// 第一次的请求结果
-  request_parser::result_type result_first;
-  /// 数据接收中标识
+#if !defined(__linux__)
+  /// Buffer for sending file bodies where sendfile() is not available.
+  std::array<char, 65536> file_buffer_;
+#endif // !defined(__linux__)
+
+  /// 数据接收中标识：请求头已解析完，正在接收body
   bool receiving_=false;
-  /// post 方法中，内容的长度
-  unsigned int content_length_=0;
+  /// 请求body的长度(Content-Length)
+  std::size_t content_length_=0;
+
+  /// Number of body bytes received so far.
+  std::size_t body_received_ = 0;
+
+  /// Receives the body of the current request when it is streamed rather
+  /// than collected in request_.content.
+  body_reader body_reader_;
+
+  /// Whether the connection stays open once the current reply is written.
+  bool keep_alive_ = false;
+
+  /// Set once a reply that closes the connection has been queued; any data
+  /// after that request is ignored.
+  bool closing_ = false;
+
+  /// Set while the reply to the current request is deferred. No further
+  /// requests are handled until it arrives.
+  bool waiting_ = false;
+
+  /// Set while watch_peer() waits for the socket to become readable.
+  bool watching_ = false;
+
+  /// Set while replies are being written.
+  bool writing_ = false;
+
+  /// Number of requests served on this connection so far.
+  std::size_t requests_served_ = 0;
+
+  /// When the current request was complete, and when writing the current
+  /// replies began.
+  std::chrono::steady_clock::time_point handle_start_;
+  std::chrono::steady_clock::time_point write_start_;
+
+  /// Set by the connection_manager on start. A new id is given whenever the
+  /// object is reused, so that a deferred reply meant for an earlier
+  /// connection is not sent on this one.
+  connection_id id_ = 0;
 };
 
 typedef std::shared_ptr<connection> connection_ptr;
@@ -9,31 +9,145 @@
 //
 
 #include "connection_manager.hpp"
+#include <utility>
 
 namespace http {
 namespace server {
 
-connection_manager::connection_manager()
+namespace {
+
+/// How many pooled connections to look at before giving up and allocating.
+/// Connections are pooled in the order they stopped, so the first ones are
+/// the most likely to have finished their pending operations.
+const std::size_t max_pool_probes = 4;
+
+/// Marks the end of the free slot list.
+const std::uint32_t no_slot = 0xffffffff;
+
+} // namespace
+
+connection_manager::connection_manager(shard_metrics& metrics,
+    std::size_t max_pooled)
+  : metrics_(metrics),
+    free_head_(no_slot),
+    max_pooled_(max_pooled)
+{
+}
+
+connection_ptr connection_manager::create(asio::ip::tcp::socket socket,
+    request_handler& handler, timer_wheel& timers, const options& opts)
+{
+  for (std::size_t i = 0; i < max_pool_probes && i < pool_.size(); ++i)
+  {
+    if (pool_.front().use_count() == 1)
+    {
+      connection_ptr c = std::move(pool_.front());
+      pool_.pop_front();
+      c->restart(std::move(socket));
+      metrics_.pool_hits.add();
+      return c;
+    }
+    // Still busy: try it again later.
+    pool_.push_back(std::move(pool_.front()));
+    pool_.pop_front();
+  }
+
+  metrics_.pool_misses.add();
+  return std::make_shared<connection>(std::move(socket), *this, handler,
+      timers, opts);
+}
+
+void connection_manager::set_stop_handler(stop_handler handler)
 {
+  stop_handler_ = std::move(handler);
 }
 
-void connection_manager::start(connection_ptr c)
+void connection_manager::start(connection_ptr c,
+    const asio::ip::address& client)
 {
-  connections_.insert(c);
+  std::uint32_t index = acquire_slot();
+  slot& s = slots_[index];
+  s.conn = c;
+  s.client = client;
+  c->id_ = (static_cast<connection_id>(s.generation) << 32) | index;
+  ++size_;
+  metrics_.connections_accepted.add();
   c->start();
 }
 
 void connection_manager::stop(connection_ptr c)
 {
-  connections_.erase(c);
+  // A connection may be stopped from several completion handlers; only the
+  // first one finds it still in its slot.
+  const slot* found = lookup(c->id_);
+  if (!found || found->conn != c)
+    return;
+
+  std::uint32_t index = static_cast<std::uint32_t>(c->id_);
+  slot& s = slots_[index];
+  asio::ip::address client = s.client;
+  s.conn.reset();
+  if (++s.generation == 0)
+    s.generation = 1;
+  s.next_free = free_head_;
+  free_head_ = index;
+  --size_;
+  metrics_.connections_closed.add();
+
   c->stop();
+  if (pool_.size() < max_pooled_)
+    pool_.push_back(std::move(c));
+  if (stop_handler_)
+    stop_handler_(client);
 }
 
 void connection_manager::stop_all()
 {
-  for (auto c: connections_)
-    c->stop();
-  connections_.clear();
+  std::vector<slot> stopped;
+  stopped.swap(slots_);
+  free_head_ = no_slot;
+  size_ = 0;
+  pool_.clear();
+  for (auto& s: stopped)
+  {
+    if (s.conn)
+    {
+      metrics_.connections_closed.add();
+      s.conn->stop();
+      if (stop_handler_)
+        stop_handler_(s.client);
+    }
+  }
+}
+
+connection_ptr connection_manager::find(connection_id id) const
+{
+  const slot* s = lookup(id);
+  return s ? s->conn : connection_ptr();
+}
+
+std::uint32_t connection_manager::acquire_slot()
+{
+  if (free_head_ != no_slot)
+  {
+    std::uint32_t index = free_head_;
+    free_head_ = slots_[index].next_free;
+    return index;
+  }
+  slots_.emplace_back();
+  return static_cast<std::uint32_t>(slots_.size() - 1);
+}
+
+const connection_manager::slot* connection_manager::lookup(
+    connection_id id) const
+{
+  std::uint32_t index = static_cast<std::uint32_t>(id);
+  if (index >= slots_.size())
+    return nullptr;
+  const slot& s = slots_[index];
+  if (!s.conn || s.generation != static_cast<std::uint32_t>(id >> 32))
+    return nullptr;
+  return &s;
 }
 
 } // namespace server
@@ -11,35 +11,99 @@
 #ifndef HTTP_CONNECTION_MANAGER_HPP
 #define HTTP_CONNECTION_MANAGER_HPP
 
-#include <set>
+#include <asio.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
 #include "connection.hpp"
+#include "metrics.hpp"
 
 namespace http {
 namespace server {
 
 /// Manages open connections so that they may be cleanly stopped when the server
-/// needs to shut down.
+/// needs to shut down. Each shard has its own manager, used only from the
+/// shard's thread, so it needs no locking.
+///
+/// Open connections are kept in a slot map: a connection remembers its slot
+/// in its id, so adding and removing one takes constant time and does not
+/// allocate once the slots have grown to the peak number of connections.
 class connection_manager
 {
 public:
   connection_manager(const connection_manager&) = delete;
   connection_manager& operator=(const connection_manager&) = delete;
 
-  /// Construct a connection manager.
-  connection_manager();
+  /// Construct a connection manager recording into the given metrics and
+  /// keeping up to max_pooled stopped connections for reuse.
+  connection_manager(shard_metrics& metrics, std::size_t max_pooled);
 
-  /// Add the specified connection to the manager and start it.
-  void start(connection_ptr c);
+  /// Get a connection for a newly accepted socket, reusing a stopped one
+  /// when possible so that accepting does not allocate.
+  connection_ptr create(asio::ip::tcp::socket socket,
+      request_handler& handler, timer_wheel& timers, const options& opts);
 
-  /// Stop the specified connection.
+  /// Called with the client address of each connection once it is stopped.
+  typedef std::function<void(const asio::ip::address& client)> stop_handler;
+
+  /// Set the handler called when a connection is stopped.
+  void set_stop_handler(stop_handler handler);
+
+  /// Add the specified connection from the given client to the manager,
+  /// giving it a new id, and start it.
+  void start(connection_ptr c, const asio::ip::address& client);
+
+  /// Stop the specified connection. Does nothing if it was already stopped.
   void stop(connection_ptr c);
 
   /// Stop all connections.
   void stop_all();
 
+  /// Get the open connection with the given id, or null if it has been
+  /// stopped since.
+  connection_ptr find(connection_id id) const;
+
+  /// Number of open connections.
+  std::size_t size() const { return size_; }
+
+  /// The metrics of the shard the connections belong to.
+  shard_metrics& metrics() { return metrics_; }
+
 private:
-  /// The managed connections.
-  std::set<connection_ptr> connections_;
+  /// Where connection events are counted.
+  shard_metrics& metrics_;
+
+  /// A place for one connection. The generation is advanced whenever the
+  /// slot is vacated, so ids of earlier occupants no longer match it.
+  struct slot
+  {
+    connection_ptr conn;
+    asio::ip::address client;
+    std::uint32_t generation = 1;
+    std::uint32_t next_free = 0;
+  };
+
+  /// Take a free slot, growing the map if there is none.
+  std::uint32_t acquire_slot();
+
+  /// The slot holding the connection with the given id, or null.
+  const slot* lookup(connection_id id) const;
+
+  /// The managed connections, and the head of the list of free slots
+  /// threaded through them.
+  std::vector<slot> slots_;
+  std::uint32_t free_head_;
+  std::size_t size_ = 0;
+
+  stop_handler stop_handler_;
+
+  /// Stopped connections waiting to be reused, oldest first. One can be
+  /// reused once the pool holds the only reference to it, i.e. all of its
+  /// pending operations have completed.
+  std::deque<connection_ptr> pool_;
+  std::size_t max_pooled_;
 };
 
 } // namespace server
@@ -0,0 +1,189 @@
+//
+// file_cache.cpp
+// ~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "file_cache.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mime_types.hpp"
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// Upper bound on remembered missing paths, so that requests for random
+/// paths cannot grow the cache without limit.
+const std::size_t max_missing_entries = 4096;
+
+bool same_file(const file_cache::entry& e, const struct stat& st)
+{
+  return e.inode == st.st_ino && e.size == st.st_size
+    && e.mtime == st.st_mtim.tv_sec && e.mtime_nsec == st.st_mtim.tv_nsec;
+}
+
+/// Memory held by a variant beyond the entry's content.
+std::size_t variant_bytes(const file_cache::entry& e,
+    const std::shared_ptr<const std::string>& variant)
+{
+  return variant && variant != e.content ? variant->size() : 0;
+}
+
+/// Memory held by an entry: its content and compressed variants.
+std::size_t entry_bytes(const file_cache::entry& e)
+{
+  std::size_t bytes = e.content->size();
+  for (const auto& variant: e.compressed)
+    bytes += variant_bytes(e, variant);
+  return bytes;
+}
+
+} // namespace
+
+file_cache::file_cache(std::size_t max_bytes, std::size_t max_entry_bytes,
+    std::chrono::milliseconds revalidate_interval)
+  : max_bytes_(max_bytes),
+    max_entry_bytes_(max_entry_bytes < max_bytes ? max_entry_bytes : max_bytes),
+    revalidate_interval_(revalidate_interval)
+{
+}
+
+file_cache::entry_ptr file_cache::get(const std::string& path,
+    const std::string& extension, uncached_file& uncached)
+{
+  if (max_bytes_ == 0 || missing(path))
+    return entry_ptr();
+
+  auto found = index_.find(path);
+  if (found != index_.end())
+  {
+    lru_list::iterator it = found->second;
+    auto now = std::chrono::steady_clock::now();
+    if (now - it->validated < revalidate_interval_)
+    {
+      lru_.splice(lru_.begin(), lru_, it);
+      return it->value;
+    }
+
+    // Time to check whether the file changed since it was read.
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0 && same_file(*it->value, st))
+    {
+      it->validated = now;
+      lru_.splice(lru_.begin(), lru_, it);
+      return it->value;
+    }
+    erase(it);
+  }
+
+  entry_ptr e = load(path, extension, uncached);
+  if (!e)
+    return e;
+
+  std::size_t bytes = e->content->size();
+  while (!lru_.empty() && total_bytes_ + bytes > max_bytes_)
+    erase(std::prev(lru_.end()));
+  lru_.push_front(slot{path, e, std::chrono::steady_clock::now()});
+  index_[path] = lru_.begin();
+  total_bytes_ += bytes;
+  return e;
+}
+
+bool file_cache::missing(const std::string& path)
+{
+  auto found = missing_.find(path);
+  if (found == missing_.end())
+    return false;
+  if (std::chrono::steady_clock::now() - found->second < revalidate_interval_)
+    return true;
+  missing_.erase(found);
+  return false;
+}
+
+file_cache::entry_ptr file_cache::load(const std::string& path,
+    const std::string& extension, uncached_file& uncached)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    if (errno == ENOENT || errno == ENOTDIR)
+    {
+      if (missing_.size() >= max_missing_entries)
+        missing_.clear();
+      missing_[path] = std::chrono::steady_clock::now();
+    }
+    return entry_ptr();
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+  {
+    ::close(fd);
+    return entry_ptr();
+  }
+  if (static_cast<std::size_t>(st.st_size) > max_entry_bytes_)
+  {
+    uncached.fd = fd;
+    uncached.size = static_cast<std::size_t>(st.st_size);
+    return entry_ptr();
+  }
+
+  auto content = std::make_shared<std::string>();
+  content->resize(static_cast<std::size_t>(st.st_size));
+  std::size_t done = 0;
+  while (done < content->size())
+  {
+    ssize_t n = ::read(fd, &(*content)[done], content->size() - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    done += static_cast<std::size_t>(n);
+  }
+  ::close(fd);
+  if (done != content->size())
+    return entry_ptr();
+
+  auto e = std::make_shared<entry>();
+  e->content = content;
+  e->content_type = mime_types::extension_to_type(extension);
+  e->content_length = std::to_string(content->size());
+  e->inode = st.st_ino;
+  e->size = st.st_size;
+  e->mtime = st.st_mtim.tv_sec;
+  e->mtime_nsec = st.st_mtim.tv_nsec;
+  return e;
+}
+
+void file_cache::add_variant(const entry_ptr& e,
+    compression::encoding encoding, std::shared_ptr<const std::string> variant)
+{
+  if (!e->cached || e->compressed[encoding])
+    return;
+  std::size_t bytes = variant_bytes(*e, variant);
+  while (!lru_.empty() && total_bytes_ + bytes > max_bytes_
+      && lru_.back().value != e)
+    erase(std::prev(lru_.end()));
+  if (total_bytes_ + bytes > max_bytes_)
+    return;
+  e->compressed[encoding] = std::move(variant);
+  total_bytes_ += bytes;
+}
+
+void file_cache::erase(lru_list::iterator it)
+{
+  it->value->cached = false;
+  total_bytes_ -= entry_bytes(*it->value);
+  index_.erase(it->path);
+  lru_.erase(it);
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,143 @@
+//
+// file_cache.hpp
+// ~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_FILE_CACHE_HPP
+#define HTTP_FILE_CACHE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <sys/types.h>
+#include "compression.hpp"
+
+namespace http {
+namespace server {
+
+/// An in-memory cache of small, frequently requested files, evicting the least
+/// recently used files once the total size exceeds a limit. Entries are
+/// revalidated against the file system with stat() at most once per
+/// revalidation interval. Not thread safe: each shard owns its own cache.
+class file_cache
+{
+public:
+  file_cache(const file_cache&) = delete;
+  file_cache& operator=(const file_cache&) = delete;
+
+  /// A cached file.
+  struct entry
+  {
+    /// The file contents, shared with the replies that send them.
+    std::shared_ptr<const std::string> content;
+
+    /// Content-Type header value for the file.
+    std::string_view content_type;
+
+    /// Content-Length header value for the file.
+    std::string content_length;
+
+    /// Compressed variants, created on first use and then reused. A variant
+    /// equal to content means compression did not make the file smaller.
+    /// Stored with add_variant(), which counts them against the cache size.
+    mutable std::shared_ptr<const std::string>
+      compressed[compression::encoding_count];
+
+    /// Cleared when the entry leaves the cache.
+    mutable bool cached = true;
+
+    /// File identity at the time it was read, used to detect changes.
+    ino_t inode;
+    off_t size;
+    std::time_t mtime;
+    long mtime_nsec;
+  };
+
+  typedef std::shared_ptr<const entry> entry_ptr;
+
+  /// A file found too large to be cached, left open for the caller to serve
+  /// from disk so that it is not opened twice.
+  struct uncached_file
+  {
+    /// The open file, owned by the caller, or -1.
+    int fd = -1;
+    std::size_t size = 0;
+  };
+
+  /// Construct a cache holding at most max_bytes of file data, none of the
+  /// files larger than max_entry_bytes. A max_bytes of zero disables the
+  /// cache.
+  file_cache(std::size_t max_bytes, std::size_t max_entry_bytes,
+      std::chrono::milliseconds revalidate_interval);
+
+  /// Get the file at path, reading it into the cache if needed. The extension
+  /// determines the cached Content-Type. Returns null if the file does not
+  /// exist, is not a regular file or is too large to be cached; the caller
+  /// must then serve it from disk. A file too large to be cached is returned
+  /// open in uncached.
+  entry_ptr get(const std::string& path, const std::string& extension,
+      uncached_file& uncached);
+
+  /// Whether the file at path was recently found not to exist, in which case
+  /// there is no need to look for it again.
+  bool missing(const std::string& path);
+
+  /// Keep a compressed variant with a cached entry. Its size counts against
+  /// the cache size, and other entries are evicted to make room for it. A
+  /// variant that does not fit, or whose entry has left the cache, is not
+  /// kept.
+  void add_variant(const entry_ptr& e, compression::encoding encoding,
+      std::shared_ptr<const std::string> variant);
+
+  /// Total size of the cached files and their compressed variants.
+  std::size_t size() const { return total_bytes_; }
+
+private:
+  struct slot
+  {
+    std::string path;
+    entry_ptr value;
+
+    /// When the entry was last checked against the file system.
+    std::chrono::steady_clock::time_point validated;
+  };
+
+  typedef std::list<slot> lru_list;
+
+  /// Read the file into a new entry. Returns null if it cannot be cached,
+  /// with the file open in uncached if it is too large.
+  entry_ptr load(const std::string& path, const std::string& extension,
+      uncached_file& uncached);
+
+  /// Remove the entry at the given position.
+  void erase(lru_list::iterator it);
+
+  /// Entries, most recently used first.
+  lru_list lru_;
+
+  /// Index from path to position in lru_.
+  std::unordered_map<std::string, lru_list::iterator> index_;
+
+  /// Paths recently found not to exist, and when. Cleared when it grows too
+  /// large.
+  std::unordered_map<std::string, std::chrono::steady_clock::time_point>
+    missing_;
+
+  std::size_t max_bytes_;
+  std::size_t max_entry_bytes_;
+  std::chrono::milliseconds revalidate_interval_;
+  std::size_t total_bytes_ = 0;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_FILE_CACHE_HPP
@@ -11,15 +11,67 @@
 #ifndef HTTP_HEADER_HPP
 #define HTTP_HEADER_HPP
 
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <utility>
 
 namespace http {
 namespace server {
 
-struct header
+/// A header name and value. Allocator-aware: stored in a container with a
+/// polymorphic allocator, its strings allocate from the same memory resource.
+template <typename Allocator = std::allocator<char>>
+struct basic_header
 {
-  std::string name;
-  std::string value;
+  typedef Allocator allocator_type;
+  typedef std::basic_string<char, std::char_traits<char>, Allocator>
+    string_type;
+
+  basic_header() = default;
+  basic_header(const basic_header&) = default;
+  basic_header(basic_header&&) = default;
+  basic_header& operator=(const basic_header&) = default;
+  basic_header& operator=(basic_header&&) = default;
+
+  explicit basic_header(const Allocator& alloc)
+    : name(alloc), value(alloc)
+  {
+  }
+
+  basic_header(std::string_view n, std::string_view v,
+      const Allocator& alloc = Allocator())
+    : name(n, alloc), value(v, alloc)
+  {
+  }
+
+  basic_header(const basic_header& other, const Allocator& alloc)
+    : name(other.name, alloc), value(other.value, alloc)
+  {
+  }
+
+  basic_header(basic_header&& other, const Allocator& alloc)
+    : name(std::move(other.name), alloc), value(std::move(other.value), alloc)
+  {
+  }
+
+  string_type name;
+  string_type value;
+};
+
+typedef basic_header<> header;
+
+namespace pmr {
+typedef basic_header<std::pmr::polymorphic_allocator<char>> header;
+} // namespace pmr
+
+/// A header name and value referring to memory owned by someone else, see
+/// request_view.
+struct header_view
+{
+  std::string_view name;
+  std::string_view value;
 };
 
 } // namespace server
@@ -0,0 +1,339 @@
+//
+// header_index.cpp
+// ~~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "header_index.hpp"
+#include <cstring>
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// ASCII lower case of each byte.
+struct lower_table
+{
+  constexpr lower_table()
+    : value()
+  {
+    for (int i = 0; i < 256; ++i)
+      value[i] = static_cast<unsigned char>(
+          i >= 'A' && i <= 'Z' ? i + ('a' - 'A') : i);
+  }
+
+  unsigned char value[256];
+};
+
+constexpr lower_table lower;
+
+inline unsigned char to_lower(char c)
+{
+  return lower.value[static_cast<unsigned char>(c)];
+}
+
+/// The first and last eight bytes of a name, which overlap when it is
+/// shorter than sixteen. A name shorter than eight is packed into head the
+/// same way from four-byte pieces, or byte by byte below four.
+struct name_words
+{
+  explicit name_words(std::string_view name)
+    : head(0), tail(0)
+  {
+    const char* p = name.data();
+    std::size_t size = name.size();
+    if (size >= 8)
+    {
+      std::memcpy(&head, p, 8);
+      std::memcpy(&tail, p + size - 8, 8);
+    }
+    else if (size >= 4)
+    {
+      std::uint32_t first, last;
+      std::memcpy(&first, p, 4);
+      std::memcpy(&last, p + size - 4, 4);
+      head = first | (std::uint64_t(last) << 32);
+    }
+    else
+    {
+      for (std::size_t i = 0; i < size; ++i)
+        head |= std::uint64_t(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+  }
+
+  std::uint64_t head;
+  std::uint64_t tail;
+};
+
+/// A recognised name, kept as words to compare a name with a couple of
+/// instructions instead of byte by byte. The masks have the 0x20 bit set
+/// at the letters, so or-ing a name's words with them lowers the case of
+/// exactly those bytes.
+struct known_name
+{
+  explicit known_name(const char* name)
+    : text(name), words(text), head_mask(0), tail_mask(0)
+  {
+    // Lay out the letter positions the same way as the name's bytes.
+    char letters[32] = {};
+    for (std::size_t i = 0; i < text.size(); ++i)
+      letters[i] = name[i] >= 'a' && name[i] <= 'z' ? 0x20 : 0;
+    name_words masks(std::string_view(letters, text.size()));
+    head_mask = masks.head;
+    tail_mask = masks.tail;
+  }
+
+  /// Whether a name of the same size, with the given words, is this one,
+  /// ignoring case.
+  bool matches(std::string_view name, const name_words& w) const
+  {
+    if ((w.head | head_mask) != words.head
+        || (w.tail | tail_mask) != words.tail)
+      return false;
+    // The words miss the middle of names longer than sixteen.
+    for (std::size_t i = 8; i + 8 < name.size(); ++i)
+      if (to_lower(name[i]) != static_cast<unsigned char>(text[i]))
+        return false;
+    return true;
+  }
+
+  std::string_view text;
+  name_words words;
+  std::uint64_t head_mask;
+  std::uint64_t tail_mask;
+};
+
+/// The recognised header names in lower case, in header_id order.
+const known_name known_headers[header_other] =
+{
+  known_name("host"),
+  known_name("connection"),
+  known_name("content-length"),
+  known_name("content-type"),
+  known_name("transfer-encoding"),
+  known_name("expect"),
+  known_name("accept"),
+  known_name("accept-encoding"),
+  known_name("user-agent"),
+  known_name("cookie"),
+  known_name("authorization"),
+  known_name("if-none-match"),
+  known_name("if-modified-since"),
+  known_name("range"),
+  known_name("upgrade"),
+};
+
+inline bool is(header_id id, std::string_view name, const name_words& w)
+{
+  return known_headers[id].matches(name, w);
+}
+
+/// Classify a header name whose words are already loaded. The length picks
+/// at most three candidates.
+header_id classify(std::string_view name, const name_words& w)
+{
+  switch (name.size())
+  {
+  case 4:
+    if (is(header_host, name, w))
+      return header_host;
+    break;
+  case 5:
+    if (is(header_range, name, w))
+      return header_range;
+    break;
+  case 6:
+    if (is(header_accept, name, w))
+      return header_accept;
+    if (is(header_cookie, name, w))
+      return header_cookie;
+    if (is(header_expect, name, w))
+      return header_expect;
+    break;
+  case 7:
+    if (is(header_upgrade, name, w))
+      return header_upgrade;
+    break;
+  case 10:
+    if (is(header_user_agent, name, w))
+      return header_user_agent;
+    if (is(header_connection, name, w))
+      return header_connection;
+    break;
+  case 12:
+    if (is(header_content_type, name, w))
+      return header_content_type;
+    break;
+  case 13:
+    if (is(header_authorization, name, w))
+      return header_authorization;
+    if (is(header_if_none_match, name, w))
+      return header_if_none_match;
+    break;
+  case 14:
+    if (is(header_content_length, name, w))
+      return header_content_length;
+    break;
+  case 15:
+    if (is(header_accept_encoding, name, w))
+      return header_accept_encoding;
+    break;
+  case 17:
+    if (is(header_transfer_encoding, name, w))
+      return header_transfer_encoding;
+    if (is(header_if_modified_since, name, w))
+      return header_if_modified_since;
+    break;
+  }
+  return header_other;
+}
+
+/// Case-insensitive hash of a name: its words, with the 0x20 bit set
+/// throughout, mixed with its length. Names that differ only in the middle
+/// collide, which costs a comparison but nothing more.
+std::uint32_t hash(std::string_view name, const name_words& w)
+{
+  const std::uint64_t fold = 0x2020202020202020ull;
+  std::uint64_t h = ((w.head | fold) * 0x9e3779b97f4a7c15ull)
+    ^ ((w.tail | fold) * 0xc2b2ae3d27d4eb4full) ^ name.size();
+  return static_cast<std::uint32_t>(h ^ (h >> 32));
+}
+
+bool equals(std::string_view name, const char* literal)
+{
+  return std::memcmp(name.data(), literal, name.size()) == 0;
+}
+
+} // namespace
+
+method_id classify_method(std::string_view name)
+{
+  switch (name.size())
+  {
+  case 3:
+    if (equals(name, "GET"))
+      return method_get;
+    if (equals(name, "PUT"))
+      return method_put;
+    break;
+  case 4:
+    if (equals(name, "POST"))
+      return method_post;
+    if (equals(name, "HEAD"))
+      return method_head;
+    break;
+  case 5:
+    if (equals(name, "PATCH"))
+      return method_patch;
+    if (equals(name, "TRACE"))
+      return method_trace;
+    break;
+  case 6:
+    if (equals(name, "DELETE"))
+      return method_delete;
+    break;
+  case 7:
+    if (equals(name, "OPTIONS"))
+      return method_options;
+    if (equals(name, "CONNECT"))
+      return method_connect;
+    break;
+  }
+  return method_other;
+}
+
+header_id classify_header(std::string_view name)
+{
+  return classify(name, name_words(name));
+}
+
+bool header_name_equals(std::string_view a, std::string_view b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (std::size_t i = 0; i < a.size(); ++i)
+    if (to_lower(a[i]) != to_lower(b[i]))
+      return false;
+  return true;
+}
+
+header_index::header_index()
+{
+  clear();
+}
+
+void header_index::build(const std::vector<header_view>& headers)
+{
+  clear();
+
+  std::size_t mask = 0;
+  for (std::size_t i = 0; i < headers.size(); ++i)
+  {
+    std::string_view name = headers[i].name;
+    name_words words(name);
+    header_id id = classify(name, words);
+    if (id != header_other)
+    {
+      if (slots_[id] == 0)
+        slots_[id] = static_cast<std::uint32_t>(i + 1);
+      continue;
+    }
+
+    // The table is made when the first other name is found, big enough for
+    // all the headers to be other names.
+    if (table_.empty())
+    {
+      std::size_t size = 8;
+      while (size < headers.size() * 2)
+        size *= 2;
+      table_.assign(size, entry{0, 0});
+      mask = size - 1;
+    }
+    std::uint32_t h = hash(name, words);
+    for (std::size_t e = h & mask; ; e = (e + 1) & mask)
+    {
+      if (table_[e].position == 0)
+      {
+        table_[e] = entry{h, static_cast<std::uint32_t>(i + 1)};
+        break;
+      }
+      if (table_[e].hash == h
+          && header_name_equals(headers[table_[e].position - 1].name, name))
+        break;
+    }
+  }
+}
+
+void header_index::clear()
+{
+  for (std::size_t i = 0; i < header_other; ++i)
+    slots_[i] = 0;
+  table_.clear();
+}
+
+std::size_t header_index::find(std::string_view name,
+    const std::vector<header_view>& headers) const
+{
+  name_words words(name);
+  header_id id = classify(name, words);
+  if (id != header_other)
+    return find(id);
+  if (table_.empty())
+    return npos;
+
+  std::uint32_t h = hash(name, words);
+  std::size_t mask = table_.size() - 1;
+  for (std::size_t e = h & mask; table_[e].position != 0; e = (e + 1) & mask)
+  {
+    if (table_[e].hash == h
+        && header_name_equals(headers[table_[e].position - 1].name, name))
+      return table_[e].position - 1;
+  }
+  return npos;
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,119 @@
+//
+// header_index.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_HEADER_INDEX_HPP
+#define HTTP_HEADER_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "header.hpp"
+
+namespace http {
+namespace server {
+
+/// Request methods recognised by the parser. Any other method is
+/// method_other, and its name is only in request_view::method.
+enum method_id
+{
+  method_other = 0,
+  method_get,
+  method_head,
+  method_post,
+  method_put,
+  method_delete,
+  method_options,
+  method_patch,
+  method_connect,
+  method_trace
+};
+
+/// Header names recognised by the parser, so that they can be found without
+/// comparing names. header_other stands for any other name and must stay
+/// last: it is the number of recognised names.
+enum header_id
+{
+  header_host = 0,
+  header_connection,
+  header_content_length,
+  header_content_type,
+  header_transfer_encoding,
+  header_expect,
+  header_accept,
+  header_accept_encoding,
+  header_user_agent,
+  header_cookie,
+  header_authorization,
+  header_if_none_match,
+  header_if_modified_since,
+  header_range,
+  header_upgrade,
+  header_other
+};
+
+/// Classify a method name. Method names are case-sensitive.
+method_id classify_method(std::string_view name);
+
+/// Classify a header name, ignoring case.
+header_id classify_header(std::string_view name);
+
+/// Whether two header names are equal, ignoring ASCII case. Names of
+/// different lengths are told apart without looking at them.
+bool header_name_equals(std::string_view a, std::string_view b);
+
+/// Finds the headers of a request by name in constant time. Each recognised
+/// name has a slot; the rest go in a small open-addressed table keyed by a
+/// case-insensitive hash. Where a name is repeated the first header wins.
+/// The index holds positions in the header list it was built from, which
+/// must not change afterwards, and keeps its storage for the next request.
+class header_index
+{
+public:
+  /// Returned by find() when there is no such header.
+  static const std::size_t npos = static_cast<std::size_t>(-1);
+
+  header_index();
+
+  /// Index the given headers, replacing anything indexed before.
+  void build(const std::vector<header_view>& headers);
+
+  /// Forget all headers.
+  void clear();
+
+  /// Position of the first header with a recognised name, or npos.
+  std::size_t find(header_id id) const
+  {
+    return static_cast<std::size_t>(slots_[id]) - 1;
+  }
+
+  /// Position of the first header with the given name in headers, which must
+  /// be the list the index was built from, or npos.
+  std::size_t find(std::string_view name,
+      const std::vector<header_view>& headers) const;
+
+private:
+  /// Position + 1 of the first header with each recognised name, 0 if none.
+  std::uint32_t slots_[header_other];
+
+  /// An entry of the table of other names. Position 0 marks an empty entry.
+  struct entry
+  {
+    std::uint32_t hash;
+    std::uint32_t position; // position + 1
+  };
+
+  /// Open-addressed with linear probing; the size is a power of two at
+  /// least twice the number of headers, or zero if all names are recognised.
+  std::vector<entry> table_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_HEADER_INDEX_HPP
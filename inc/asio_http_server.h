@@ -1,19 +1,59 @@
 #ifndef ASIO_HTTP_SERVER_H
 #define ASIO_HTTP_SERVER_H
+#include <functional>
 #include <string>
 
+#include "options.hpp"
 #include "reply.hpp"
 #include "request.hpp"
+#include "request_view.hpp"
+#include "responder.hpp"
 
 typedef void (* _HTTP_SERVER_CALLBACK)(http::server::request, http::server::reply&);
 
+/// Callback receiving the request by reference and a user context pointer.
+typedef void (* _HTTP_SERVER_CONTEXT_CALLBACK)(const http::server::request&,
+    http::server::reply&, void* context);
+
+/// Callable receiving the request by reference, e.g. a lambda with captures.
+typedef std::function<void(const http::server::request&,
+    http::server::reply&)> _HTTP_SERVER_FUNCTION;
+
+/// Callable answering later, from any thread, through the responder.
+typedef std::function<void(const http::server::request&,
+    http::server::responder)> _HTTP_SERVER_ASYNC_FUNCTION;
+
 class asio_http_server{
 public:
     virtual void run() = 0;
+    /// Set the request callback. Each form receives the one owning copy of
+    /// the request made for it; the by-value form has it moved in rather
+    /// than copied again.
     virtual void set_callback(_HTTP_SERVER_CALLBACK _pfunc_callback) = 0;
+    virtual void set_callback(_HTTP_SERVER_CONTEXT_CALLBACK _pfunc_callback,
+                              void* context) = 0;
+    /// Set the request callback to a callable, e.g. a lambda. It has a name
+    /// of its own, as a captureless lambda converts to the pointer types
+    /// above as well and would make set_callback ambiguous.
+    virtual void set_handler(_HTTP_SERVER_FUNCTION callback) = 0;
+    /// Set a callback that answers asynchronously; it replaces the above.
+    virtual void set_async_callback(_HTTP_SERVER_ASYNC_FUNCTION callback) = 0;
+    /// Answer method requests matching pattern, e.g. "/users/:id" or
+    /// "/files/*path", with handler instead of the callback and doc root.
+    /// Captures are in request::route_params. A method of "*" matches all.
+    virtual void add_route(const std::string& method,
+                           const std::string& pattern,
+                           _HTTP_SERVER_FUNCTION handler) = 0;
+    /// Stream request bodies to readers chosen by handler, see body_handler.
+    virtual void set_body_handler(http::server::body_handler handler) = 0;
 };
 
 extern "C" asio_http_server *create_asio_http_server(const std::string& address,
                                                      const std::string& port,
                                                      const std::string& doc_root);
+
+/// Create a server with explicit options, e.g. to run one shard per core.
+extern "C" asio_http_server *create_asio_http_server_with_options(
+    const std::string& address, const std::string& port,
+    const std::string& doc_root, const http::server::options& opts);
 #endif // ASIO_HTTP_SERVER_H
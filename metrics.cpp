@@ -0,0 +1,221 @@
+//
+// metrics.cpp
+// ~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "metrics.hpp"
+#include <cstdio>
+
+namespace http {
+namespace server {
+
+namespace {
+
+/// Index of the highest bit set in a non-zero value.
+std::size_t highest_bit(std::uint64_t value)
+{
+#if defined(__GNUC__)
+  return 63 - static_cast<std::size_t>(__builtin_clzll(value));
+#else
+  std::size_t bit = 0;
+  while (value >>= 1)
+    ++bit;
+  return bit;
+#endif // defined(__GNUC__)
+}
+
+/// Durations are reported from about a microsecond up; the buckets below are
+/// folded into the first one reported.
+const std::uint64_t smallest_reported = 1024;
+
+void append(std::string& out, const char* format, const char* name,
+    std::uint64_t value)
+{
+  char line[160];
+  int n = std::snprintf(line, sizeof(line), format, name,
+      static_cast<unsigned long long>(value));
+  if (n > 0)
+    out.append(line, static_cast<std::size_t>(n));
+}
+
+void append_counter(std::string& out, const char* name, const char* help,
+    std::uint64_t value, const char* type = "counter")
+{
+  out += "# HELP ";
+  out += name;
+  out += ' ';
+  out += help;
+  out += "\n# TYPE ";
+  out += name;
+  out += ' ';
+  out += type;
+  out += '\n';
+  append(out, "%s %llu\n", name, value);
+}
+
+} // namespace
+
+void histogram::record(std::chrono::steady_clock::duration d)
+{
+  std::int64_t ns =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+  std::uint64_t value = ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+  buckets_[bucket_of(value)].add();
+  sum_.add(value);
+}
+
+std::uint64_t histogram::lower_bound(std::size_t bucket)
+{
+  const std::size_t sub_count = std::size_t(1) << sub_bits;
+  if (bucket < sub_count)
+    return bucket;
+  std::size_t bit = (bucket >> sub_bits) + sub_bits - 1;
+  std::uint64_t sub = bucket & (sub_count - 1);
+  return (sub_count + sub) << (bit - sub_bits);
+}
+
+std::size_t histogram::bucket_of(std::uint64_t value)
+{
+  const std::size_t sub_count = std::size_t(1) << sub_bits;
+  if (value < sub_count)
+    return static_cast<std::size_t>(value);
+  std::size_t bit = highest_bit(value);
+  if (bit >= max_bits)
+    return bucket_count - 1;
+  // The bits below the highest one pick the bucket within its power of two.
+  return ((bit - sub_bits + 1) << sub_bits)
+    + static_cast<std::size_t>((value >> (bit - sub_bits)) & (sub_count - 1));
+}
+
+void metrics_registry::add(const shard_metrics& m)
+{
+  shards_.push_back(&m);
+}
+
+void metrics_registry::render(std::string& out) const
+{
+  struct counter_field
+  {
+    const char* name;
+    const char* help;
+    counter shard_metrics::*field;
+  };
+  static const counter_field counters[] =
+  {
+    { "http_connections_accepted_total", "Connections accepted.",
+      &shard_metrics::connections_accepted },
+    { "http_connections_refused_total",
+      "Connections refused because of connection limits and sent a 503 reply.",
+      &shard_metrics::connections_refused },
+    { "http_refusals_failed_total",
+      "Refused connections that could not be sent the whole 503 reply.",
+      &shard_metrics::refusals_failed },
+    { "http_connections_closed_total", "Connections closed.",
+      &shard_metrics::connections_closed },
+    { "http_connections_timed_out_total",
+      "Connections closed because a timeout expired.",
+      &shard_metrics::connections_timed_out },
+    { "http_connection_pool_hits_total",
+      "Connections that reused a pooled connection object.",
+      &shard_metrics::pool_hits },
+    { "http_connection_pool_misses_total",
+      "Connections that needed a new connection object.",
+      &shard_metrics::pool_misses },
+    { "http_requests_total", "Requests answered.",
+      &shard_metrics::requests },
+    { "http_received_bytes_total", "Bytes received from clients.",
+      &shard_metrics::bytes_received },
+    { "http_sent_bytes_total", "Bytes sent to clients.",
+      &shard_metrics::bytes_sent },
+  };
+
+  auto sum = [this](counter shard_metrics::*field)
+    {
+      std::uint64_t total = 0;
+      for (auto* m: shards_)
+        total += ((*m).*field).value();
+      return total;
+    };
+
+  for (auto& c: counters)
+    append_counter(out, c.name, c.help, sum(c.field));
+
+  append_counter(out, "http_connections_open", "Connections open now.",
+      sum(&shard_metrics::connections_accepted)
+        - sum(&shard_metrics::connections_closed), "gauge");
+
+  out += "# HELP http_replies_total Replies by status class.\n"
+    "# TYPE http_replies_total counter\n";
+  for (std::size_t i = 0; i < 5; ++i)
+  {
+    std::uint64_t total = 0;
+    for (auto* m: shards_)
+      total += m->replies[i].value();
+    char line[64];
+    int n = std::snprintf(line, sizeof(line),
+        "http_replies_total{code=\"%zuxx\"} %llu\n", i + 1,
+        static_cast<unsigned long long>(total));
+    out.append(line, static_cast<std::size_t>(n));
+  }
+
+  struct histogram_field
+  {
+    const char* name;
+    const char* help;
+    histogram shard_metrics::*field;
+  };
+  static const histogram_field histograms[] =
+  {
+    { "http_request_parse_seconds", "Time to parse a request header.",
+      &shard_metrics::parse_time },
+    { "http_request_handle_seconds",
+      "Time from a complete request to its reply.",
+      &shard_metrics::handle_time },
+    { "http_reply_write_seconds", "Time to write replies to the client.",
+      &shard_metrics::write_time },
+  };
+
+  for (auto& h: histograms)
+  {
+    out += "# HELP ";
+    out += h.name;
+    out += ' ';
+    out += h.help;
+    out += "\n# TYPE ";
+    out += h.name;
+    out += " histogram\n";
+
+    std::uint64_t cumulative = 0;
+    std::uint64_t total_ns = 0;
+    for (auto* m: shards_)
+      total_ns += ((*m).*h.field).sum();
+    for (std::size_t i = 0; i + 1 < histogram::bucket_count; ++i)
+    {
+      for (auto* m: shards_)
+        cumulative += ((*m).*h.field).count(i);
+      std::uint64_t bound = histogram::lower_bound(i + 1);
+      if (bound < smallest_reported)
+        continue;
+      char line[160];
+      int n = std::snprintf(line, sizeof(line),
+          "%s_bucket{le=\"%.9g\"} %llu\n", h.name, bound / 1e9,
+          static_cast<unsigned long long>(cumulative));
+      out.append(line, static_cast<std::size_t>(n));
+    }
+    for (auto* m: shards_)
+      cumulative += ((*m).*h.field).count(histogram::bucket_count - 1);
+
+    append(out, "%s_bucket{le=\"+Inf\"} %llu\n", h.name, cumulative);
+    char line[160];
+    int n = std::snprintf(line, sizeof(line), "%s_sum %.9f\n", h.name,
+        total_ns / 1e9);
+    out.append(line, static_cast<std::size_t>(n));
+    append(out, "%s_count %llu\n", h.name, cumulative);
+  }
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,127 @@
+//
+// metrics.hpp
+// ~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_METRICS_HPP
+#define HTTP_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace http {
+namespace server {
+
+/// A monotonic count updated by a single thread and read by any. The update
+/// is a plain load and store rather than an atomic read-modify-write, so it
+/// costs no more than incrementing an ordinary integer.
+class counter
+{
+public:
+  void add(std::uint64_t n = 1)
+  {
+    value_.store(value_.load(std::memory_order_relaxed) + n,
+        std::memory_order_relaxed);
+  }
+
+  std::uint64_t value() const
+  {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<std::uint64_t> value_{0};
+};
+
+/// A histogram of durations with log-linear buckets: each power of two of
+/// nanoseconds is split into four equal buckets, so any value is placed
+/// within a quarter of its size, from one nanosecond up to about a minute.
+/// Like counter, it is updated by a single thread.
+class histogram
+{
+public:
+  static const std::size_t sub_bits = 2;
+  static const std::size_t max_bits = 36;
+  static const std::size_t bucket_count =
+    (max_bits - sub_bits + 1) << sub_bits;
+
+  /// Add a duration. Longer ones than the histogram covers go into its last
+  /// bucket.
+  void record(std::chrono::steady_clock::duration d);
+
+  /// Number of durations in a bucket.
+  std::uint64_t count(std::size_t bucket) const
+  {
+    return buckets_[bucket].value();
+  }
+
+  /// Sum of all durations, in nanoseconds.
+  std::uint64_t sum() const { return sum_.value(); }
+
+  /// The smallest value, in nanoseconds, that falls into a bucket.
+  static std::uint64_t lower_bound(std::size_t bucket);
+
+  /// The bucket a value in nanoseconds falls into.
+  static std::size_t bucket_of(std::uint64_t value);
+
+private:
+  std::array<counter, bucket_count> buckets_;
+  counter sum_;
+};
+
+/// The measurements of one shard. Only the shard's thread records them;
+/// the /metrics request may read them from any shard.
+struct shard_metrics
+{
+  counter connections_accepted;
+  counter connections_refused;
+  counter refusals_failed;
+  counter connections_closed;
+  counter connections_timed_out;
+  counter pool_hits;
+  counter pool_misses;
+  counter requests;
+  counter bytes_received;
+  counter bytes_sent;
+
+  /// Replies by status class: 1xx to 5xx.
+  std::array<counter, 5> replies;
+
+  /// Time to parse a complete request header.
+  histogram parse_time;
+
+  /// Time from a complete request to its reply, including any time spent
+  /// deferred or waiting for a worker thread.
+  histogram handle_time;
+
+  /// Time to write the queued replies to the client.
+  histogram write_time;
+};
+
+/// The metrics of all shards, reported together.
+class metrics_registry
+{
+public:
+  /// Include the metrics of a shard. They must outlive the registry.
+  void add(const shard_metrics& m);
+
+  /// Append the metrics, summed over all shards, in the Prometheus text
+  /// exposition format.
+  void render(std::string& out) const;
+
+private:
+  std::vector<const shard_metrics*> shards_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_METRICS_HPP
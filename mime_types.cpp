@@ -9,41 +9,264 @@
 //
 
 #include "mime_types.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <unordered_map>
 
 namespace http {
 namespace server {
 namespace mime_types {
 
+namespace {
+
 struct mapping
 {
-  const char* extension;
-  const char* mime_type;
-} mappings[] =
+  std::string_view extension;
+  std::string_view mime_type;
+};
+
 /**
  * @brief 返回header的编码设置，utf-8解决中文乱码问题
  * @details 上层根据url的后缀判断，此处只能修改固定后缀的编码头
  * @todo 无后缀返回体编码头
  * @author stx
  */
+constexpr mapping mappings[] =
 {
-  { "gif", "image/gif" },
-  { "htm", "text/html" },
+  { "htm", "text/html; charset=UTF-8" },
   { "html", "text/html; charset=UTF-8" },
+  { "css", "text/css; charset=UTF-8" },
+  { "js", "text/javascript; charset=UTF-8" },
+  { "mjs", "text/javascript; charset=UTF-8" },
+  { "txt", "text/plain; charset=UTF-8" },
+  { "csv", "text/csv; charset=UTF-8" },
+  { "md", "text/markdown; charset=UTF-8" },
+  { "json", "application/json" },
+  { "map", "application/json" },
+  { "webmanifest", "application/manifest+json" },
+  { "xml", "application/xml" },
+  { "wasm", "application/wasm" },
+  { "pdf", "application/pdf" },
+  { "zip", "application/zip" },
+  { "gz", "application/gzip" },
+  { "tar", "application/x-tar" },
+  { "bin", "application/octet-stream" },
+  { "svg", "image/svg+xml" },
+  { "png", "image/png" },
   { "jpg", "image/jpeg" },
-  { "png", "image/png" }
+  { "jpeg", "image/jpeg" },
+  { "gif", "image/gif" },
+  { "webp", "image/webp" },
+  { "avif", "image/avif" },
+  { "ico", "image/x-icon" },
+  { "bmp", "image/bmp" },
+  { "woff", "font/woff" },
+  { "woff2", "font/woff2" },
+  { "ttf", "font/ttf" },
+  { "otf", "font/otf" },
+  { "mp4", "video/mp4" },
+  { "webm", "video/webm" },
+  { "mp3", "audio/mpeg" },
+  { "ogg", "audio/ogg" },
+  { "wav", "audio/wav" }
 };
 
-std::string extension_to_type(const std::string& extension)
+constexpr std::size_t mapping_count = sizeof(mappings) / sizeof(mappings[0]);
+
+///@brief 为plain设置utf-8编码
+constexpr std::string_view default_type = "text/plain; charset=UTF-8";
+
+/// Longer extensions are never matched.
+constexpr std::size_t max_extension = 32;
+
+/// Size of the built-in hash table, a power of two.
+constexpr std::size_t table_size = 128;
+
+constexpr std::uint32_t hash(std::string_view s, std::uint32_t seed)
+{
+  std::uint32_t h = seed;
+  for (char c: s)
+    h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+  return h ^ (h >> 15);
+}
+
+/// A perfect hash of the built-in extensions: with this seed no two of them
+/// share a slot, so a lookup hashes once and compares once.
+struct perfect_table
 {
-  for (mapping m: mappings)
+  constexpr perfect_table()
+    : seed(0), slot()
   {
-    if (m.extension == extension)
+    for (std::uint32_t s = 2166136261u; seed == 0; ++s)
     {
-      return m.mime_type;
+      for (std::size_t i = 0; i < table_size; ++i)
+        slot[i] = 0;
+      bool collided = false;
+      for (std::size_t i = 0; i < mapping_count && !collided; ++i)
+      {
+        std::size_t h = hash(mappings[i].extension, s) & (table_size - 1);
+        if (slot[h] != 0)
+          collided = true;
+        else
+          slot[h] = static_cast<unsigned char>(i + 1);
+      }
+      if (!collided)
+        seed = s;
     }
   }
-  ///@brief 为plain设置utf-8编码
-  return "text/plain; charset=UTF-8";
+
+  std::uint32_t seed;
+
+  /// Index + 1 of the mapping in each slot, 0 if empty.
+  unsigned char slot[table_size];
+};
+
+constexpr perfect_table table;
+
+static_assert(mapping_count < 256 && mapping_count * 2 <= table_size,
+    "too many built-in MIME types for the table");
+
+/// Types read by load(). Strings are kept in a deque so that views of them
+/// stay valid as more are added.
+struct loaded_types
+{
+  std::deque<std::string> strings;
+  std::unordered_map<std::string_view, std::string_view> extensions;
+};
+
+loaded_types& loaded()
+{
+  static loaded_types types;
+  return types;
+}
+
+/// Lower the case of an extension into buf, which has room for
+/// max_extension bytes. Returns an empty view if it is too long.
+std::string_view to_lower(std::string_view extension, char* buf)
+{
+  if (extension.size() > max_extension)
+    return std::string_view();
+  for (std::size_t i = 0; i < extension.size(); ++i)
+  {
+    char c = extension[i];
+    buf[i] = c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+  }
+  return std::string_view(buf, extension.size());
+}
+
+/// The built-in type of a lower case extension, or null.
+const mapping* find_built_in(std::string_view extension)
+{
+  unsigned char slot =
+    table.slot[hash(extension, table.seed) & (table_size - 1)];
+  if (slot != 0 && mappings[slot - 1].extension == extension)
+    return &mappings[slot - 1];
+  return nullptr;
+}
+
+} // namespace
+
+std::string_view extension_to_type(std::string_view extension)
+{
+  char buf[max_extension];
+  std::string_view key = to_lower(extension, buf);
+  if (key.empty())
+    return default_type;
+
+  if (const mapping* m = find_built_in(key))
+    return m->mime_type;
+
+  const loaded_types& types = loaded();
+  if (!types.extensions.empty())
+  {
+    auto it = types.extensions.find(key);
+    if (it != types.extensions.end())
+      return it->second;
+  }
+  return default_type;
+}
+
+bool load(const std::string& path)
+{
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  loaded_types& types = loaded();
+  const char* space = " \t\r";
+  std::string line;
+  while (std::getline(in, line))
+  {
+    std::string_view rest(line);
+    rest = rest.substr(0, rest.find('#'));
+
+    // The first word is the type, the others its extensions. The type is
+    // only kept once one of them is new.
+    std::string_view type_word;
+    std::string_view type;
+    for (;;)
+    {
+      std::size_t begin = rest.find_first_not_of(space);
+      if (begin == std::string_view::npos)
+        break;
+      rest = rest.substr(begin);
+      std::size_t end = rest.find_first_of(space);
+      std::string_view word = rest.substr(0, end);
+      rest = end == std::string_view::npos
+        ? std::string_view() : rest.substr(end);
+
+      if (type_word.empty())
+      {
+        type_word = word;
+        continue;
+      }
+
+      char buf[max_extension];
+      std::string_view key = to_lower(word, buf);
+      if (key.empty() || find_built_in(key) || types.extensions.count(key))
+        continue;
+      if (type.empty())
+      {
+        types.strings.emplace_back(type_word);
+        type = types.strings.back();
+      }
+      types.strings.emplace_back(key);
+      types.extensions.emplace(types.strings.back(), type);
+    }
+  }
+  return true;
+}
+
+/// Non-text MIME types that still compress well, besides those with a +json
+/// or +xml suffix.
+constexpr std::string_view compressible_types[] =
+{
+  "application/javascript",
+  "application/json",
+  "application/wasm",
+  "application/xml"
+};
+
+bool is_compressible(std::string_view mime_type)
+{
+  // Compare the type without parameters such as "; charset=UTF-8".
+  std::string_view type = mime_type.substr(0, mime_type.find(';'));
+  while (!type.empty() && type.back() == ' ')
+    type.remove_suffix(1);
+  if (type.compare(0, 5, "text/") == 0)
+    return true;
+  std::size_t plus = type.rfind('+');
+  if (plus != std::string_view::npos
+      && (type.substr(plus) == "+json" || type.substr(plus) == "+xml"))
+    return true;
+  for (std::string_view t: compressible_types)
+  {
+    if (type == t)
+      return true;
+  }
+  return false;
 }
 
 } // namespace mime_types
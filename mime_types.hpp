@@ -12,13 +12,28 @@
 #define HTTP_MIME_TYPES_HPP
 
 #include <string>
+#include <string_view>
 
 namespace http {
 namespace server {
 namespace mime_types {
 
-/// Convert a file extension into a MIME type.
-std::string extension_to_type(const std::string& extension);
+/// Convert a file extension into a MIME type, ignoring the case of the
+/// extension. Common types are found in a built-in table, then those read
+/// by load(); anything else is plain text. The result refers to storage
+/// that lives as long as the program.
+std::string_view extension_to_type(std::string_view extension);
+
+/// Also map the extensions listed in a file in the mime.types format, such
+/// as /etc/mime.types: a type followed by its extensions on each line, with
+/// '#' starting a comment. The built-in types, which give text a charset,
+/// take precedence, and so do extensions read earlier. Not thread safe: call
+/// it before the server starts. Returns false if the file cannot be read.
+bool load(const std::string& path);
+
+/// Whether content of the given MIME type is worth compressing (text and
+/// text-like formats, not already compressed images or archives).
+bool is_compressible(std::string_view mime_type);
 
 } // namespace mime_types
 } // namespace server
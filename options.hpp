@@ -0,0 +1,167 @@
+//
+// options.hpp
+// ~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_OPTIONS_HPP
+#define HTTP_OPTIONS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace http {
+namespace server {
+
+/// What a shard does with new connections beyond options::max_connections.
+enum class overload_policy
+{
+  /// Stop accepting until a connection closes, leaving new ones in the
+  /// listen backlog.
+  pause_accept,
+
+  /// Accept them and answer with 503 Service Unavailable.
+  reject
+};
+
+/// Tunable settings for the server. The defaults run one shard with
+/// persistent connections; turning off keep_alive gives the connection
+/// handling of the original single-threaded server. Options that change
+/// other behaviour of the original server say how to turn it off.
+struct options
+{
+  /// Number of shards to run. Each shard owns an io_context, a SO_REUSEPORT
+  /// acceptor, a connection manager and a request handler, and runs on its own
+  /// thread. Zero means one shard per hardware thread.
+  std::size_t shards = 1;
+
+  /// Pin shard N to CPU N (modulo the number of hardware threads).
+  bool pin_shards = false;
+
+  /// Keep connections open between requests (HTTP/1.1 persistent
+  /// connections, or HTTP/1.0 with "Connection: keep-alive").
+  bool keep_alive = true;
+
+  /// Close a persistent connection after it has served this many requests.
+  /// Zero means no limit.
+  std::size_t max_keep_alive_requests = 100;
+
+  /// Most connections a shard keeps open at once; further ones are handled
+  /// as on_overload says. Zero means no limit.
+  std::size_t max_connections = 0;
+  overload_policy on_overload = overload_policy::pause_accept;
+
+  /// Most connections open at once from one client address, across all
+  /// shards. Further ones are answered with 503 Service Unavailable. Zero
+  /// means no limit.
+  std::size_t max_connections_per_client = 0;
+
+  /// Sent in the Retry-After header of 503 replies to refused connections.
+  std::chrono::seconds retry_after{1};
+
+  /// How long a refused connection is kept open after its 503 reply, for the
+  /// client to read the reply and close first. Zero closes it at once.
+  std::chrono::milliseconds refusal_linger{500};
+
+  /// Most refused connections a shard keeps lingering at once. Beyond it
+  /// they are closed as soon as their reply is written.
+  std::size_t max_lingering_refusals = 256;
+
+  /// Closed connections kept per shard for reuse by later ones, with their
+  /// buffers. Zero allocates every connection afresh.
+  std::size_t connection_pool_size = 1024;
+
+  /// Close a connection that waits longer than this for a request, whether
+  /// newly accepted or between requests. Zero means no limit. The original
+  /// server had none of these timeouts; setting this and the three below to
+  /// zero restores that.
+  std::chrono::milliseconds idle_timeout{15000};
+
+  /// Close a connection that takes longer than this from the first byte of
+  /// a request header to its end. Zero means no limit.
+  std::chrono::milliseconds header_timeout{10000};
+
+  /// Close a connection whose request body arrives at less than
+  /// body_min_rate bytes per second, measured over each body_timeout. A zero
+  /// timeout means no limit.
+  std::chrono::milliseconds body_timeout{10000};
+  std::size_t body_min_rate = 1024;
+
+  /// Close a connection whose client accepts none of a reply for this long.
+  /// Zero means no limit.
+  std::chrono::milliseconds write_timeout{30000};
+
+  /// Total size of the in-memory cache of static files, per shard. Zero
+  /// disables the cache, reading every file from disk as the original server
+  /// did.
+  std::size_t file_cache_bytes = 32 * 1024 * 1024;
+
+  /// Files larger than this are always served from disk.
+  std::size_t file_cache_max_file_bytes = 256 * 1024;
+
+  /// How long a cached file is served before checking it for changes.
+  std::chrono::milliseconds file_cache_revalidate{1000};
+
+  /// Also take the Content-Type of static files from this file in the
+  /// mime.types format, such as /etc/mime.types, for extensions the built-in
+  /// table does not know. Read once when the server is created. Empty uses
+  /// the built-in table only.
+  std::string mime_types_file;
+
+  /// Compress text-like replies above compression_min_bytes when the client
+  /// accepts it and the build has a matching library (see compression.hpp).
+  /// Off, replies are sent as they are, as the original server sent them.
+  bool compression = true;
+
+  /// Replies smaller than this are sent uncompressed.
+  std::size_t compression_min_bytes = 1024;
+
+  /// Serve file.br, file.zst or file.gz from the document root in place of
+  /// file when present and accepted by the client. Off, only file itself is
+  /// served, as by the original server.
+  bool serve_precompressed = true;
+
+  /// Decode the whole query of every request into request::params before
+  /// the callback runs, as the original server did. Off, params is left
+  /// empty and callbacks read the query through request::query_args(),
+  /// which decodes only the parameters looked up.
+  bool decode_params = false;
+
+  /// Largest request header, from the request line to the blank line that
+  /// ends it; larger ones are answered with 431 Request Header Fields Too
+  /// Large. Zero means no limit.
+  std::size_t max_header_bytes = 64 * 1024;
+
+  /// Largest request body collected whole into request::content; larger ones
+  /// are answered with 413 Payload Too Large. Bodies streamed to a
+  /// body_reader are not limited. Zero means no limit, as in the original
+  /// server.
+  std::size_t max_request_body_bytes = 8 * 1024 * 1024;
+
+  /// Run the request callback on a pool of this many threads, shared by all
+  /// shards, so that slow callbacks do not hold up other connections. The
+  /// callback must then be thread safe. Zero runs it on the shard's thread.
+  std::size_t worker_threads = 0;
+
+  /// Requests waiting for a worker thread beyond this are answered with
+  /// 503 Service Unavailable. Zero means no limit.
+  std::size_t worker_queue_limit = 1024;
+
+  /// Answer a request whose deferred reply, from an asynchronous callback or
+  /// the worker pool, has not arrived after this long with 504 Gateway
+  /// Timeout and close the connection. Zero means no limit.
+  std::chrono::milliseconds handler_timeout{30000};
+
+  /// Answer GET requests for this path with the server's metrics in the
+  /// Prometheus text format, before routes and callbacks are consulted.
+  /// Empty disables it; the metrics are collected regardless.
+  std::string metrics_path;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_OPTIONS_HPP
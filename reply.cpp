@@ -9,84 +9,117 @@
 //
 
 #include "reply.hpp"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <string>
+#include <string_view>
+#include <unistd.h>
+#include <boost/algorithm/string.hpp>
 
 namespace http {
 namespace server {
 
+file_body::file_body(int fd, std::size_t size)
+  : fd(fd),
+    size(size)
+{
+}
+
+file_body::~file_body()
+{
+  ::close(fd);
+}
+
 namespace status_strings {
 
 const std::string ok =
-  "HTTP/1.0 200 OK\r\n";
+  "HTTP/1.1 200 OK\r\n";
 const std::string created =
-  "HTTP/1.0 201 Created\r\n";
+  "HTTP/1.1 201 Created\r\n";
 const std::string accepted =
-  "HTTP/1.0 202 Accepted\r\n";
+  "HTTP/1.1 202 Accepted\r\n";
 const std::string no_content =
-  "HTTP/1.0 204 No Content\r\n";
+  "HTTP/1.1 204 No Content\r\n";
 const std::string multiple_choices =
-  "HTTP/1.0 300 Multiple Choices\r\n";
+  "HTTP/1.1 300 Multiple Choices\r\n";
 const std::string moved_permanently =
-  "HTTP/1.0 301 Moved Permanently\r\n";
+  "HTTP/1.1 301 Moved Permanently\r\n";
 const std::string moved_temporarily =
-  "HTTP/1.0 302 Moved Temporarily\r\n";
+  "HTTP/1.1 302 Moved Temporarily\r\n";
 const std::string not_modified =
-  "HTTP/1.0 304 Not Modified\r\n";
+  "HTTP/1.1 304 Not Modified\r\n";
 const std::string bad_request =
-  "HTTP/1.0 400 Bad Request\r\n";
+  "HTTP/1.1 400 Bad Request\r\n";
 const std::string unauthorized =
-  "HTTP/1.0 401 Unauthorized\r\n";
+  "HTTP/1.1 401 Unauthorized\r\n";
 const std::string forbidden =
-  "HTTP/1.0 403 Forbidden\r\n";
+  "HTTP/1.1 403 Forbidden\r\n";
 const std::string not_found =
-  "HTTP/1.0 404 Not Found\r\n";
+  "HTTP/1.1 404 Not Found\r\n";
+const std::string method_not_allowed =
+  "HTTP/1.1 405 Method Not Allowed\r\n";
+const std::string payload_too_large =
+  "HTTP/1.1 413 Payload Too Large\r\n";
+const std::string request_header_fields_too_large =
+  "HTTP/1.1 431 Request Header Fields Too Large\r\n";
 const std::string internal_server_error =
-  "HTTP/1.0 500 Internal Server Error\r\n";
+  "HTTP/1.1 500 Internal Server Error\r\n";
 const std::string not_implemented =
-  "HTTP/1.0 501 Not Implemented\r\n";
+  "HTTP/1.1 501 Not Implemented\r\n";
 const std::string bad_gateway =
-  "HTTP/1.0 502 Bad Gateway\r\n";
+  "HTTP/1.1 502 Bad Gateway\r\n";
 const std::string service_unavailable =
-  "HTTP/1.0 503 Service Unavailable\r\n";
+  "HTTP/1.1 503 Service Unavailable\r\n";
+const std::string gateway_timeout =
+  "HTTP/1.1 504 Gateway Timeout\r\n";
 
-asio::const_buffer to_buffer(reply::status_type status)
+const std::string& to_string(reply::status_type status)
 {
   switch (status)
   {
   case reply::ok:
-    return asio::buffer(ok);
+    return ok;
   case reply::created:
-    return asio::buffer(created);
+    return created;
   case reply::accepted:
-    return asio::buffer(accepted);
+    return accepted;
   case reply::no_content:
-    return asio::buffer(no_content);
+    return no_content;
   case reply::multiple_choices:
-    return asio::buffer(multiple_choices);
+    return multiple_choices;
   case reply::moved_permanently:
-    return asio::buffer(moved_permanently);
+    return moved_permanently;
   case reply::moved_temporarily:
-    return asio::buffer(moved_temporarily);
+    return moved_temporarily;
   case reply::not_modified:
-    return asio::buffer(not_modified);
+    return not_modified;
   case reply::bad_request:
-    return asio::buffer(bad_request);
+    return bad_request;
   case reply::unauthorized:
-    return asio::buffer(unauthorized);
+    return unauthorized;
   case reply::forbidden:
-    return asio::buffer(forbidden);
+    return forbidden;
   case reply::not_found:
-    return asio::buffer(not_found);
+    return not_found;
+  case reply::method_not_allowed:
+    return method_not_allowed;
+  case reply::payload_too_large:
+    return payload_too_large;
+  case reply::request_header_fields_too_large:
+    return request_header_fields_too_large;
   case reply::internal_server_error:
-    return asio::buffer(internal_server_error);
+    return internal_server_error;
   case reply::not_implemented:
-    return asio::buffer(not_implemented);
+    return not_implemented;
   case reply::bad_gateway:
-    return asio::buffer(bad_gateway);
+    return bad_gateway;
   case reply::service_unavailable:
-    return asio::buffer(service_unavailable);
+    return service_unavailable;
+  case reply::gateway_timeout:
+    return gateway_timeout;
   default:
-    return asio::buffer(internal_server_error);
+    return internal_server_error;
   }
 }
 
@@ -96,23 +129,141 @@ namespace misc_strings {
 
 const char name_value_separator[] = { ':', ' ' };
 const char crlf[] = { '\r', '\n' };
+const char date[] = { 'D', 'a', 't', 'e', ':', ' ' };
 
 } // namespace misc_strings
 
-std::vector<asio::const_buffer> reply::to_buffers()
+namespace {
+
+/// The value of the Date header for the current second, in the IMF-fixdate
+/// format of RFC 7231. Each thread formats it at most once a second and
+/// shares it between all the replies it writes in that second.
+std::string_view current_date()
 {
-  std::vector<asio::const_buffer> buffers;
-  buffers.push_back(status_strings::to_buffer(status));
-  for (std::size_t i = 0; i < headers.size(); ++i)
+  static const char days[][4] =
+    { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+  static const char months[][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+  thread_local std::time_t formatted = -1;
+  thread_local char value[32];
+  thread_local std::size_t length = 0;
+
+  std::time_t now = std::time(nullptr);
+  if (now != formatted)
+  {
+    std::tm tm;
+    ::gmtime_r(&now, &tm);
+    int n = std::snprintf(value, sizeof(value),
+        "%s, %02d %s %04d %02d:%02d:%02d GMT", days[tm.tm_wday], tm.tm_mday,
+        months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min,
+        tm.tm_sec);
+    length = n > 0 ? static_cast<std::size_t>(n) : 0;
+    formatted = now;
+  }
+  return std::string_view(value, length);
+}
+
+} // namespace
+
+void reply::detach_stock()
+{
+  if (!stock)
+    return;
+  bool has_content_type = false;
+  bool has_content_length = false;
+  for (const header& h: headers)
+  {
+    has_content_type = has_content_type
+      || boost::algorithm::iequals(h.name, "Content-Type");
+    has_content_length = has_content_length
+      || boost::algorithm::iequals(h.name, "Content-Length");
+  }
+  if (status == stock->status && content.empty()
+      && shared_content == stock->body && !file && !producer
+      && !has_content_type && !has_content_length)
+    return;
+
+  if (shared_content == stock->body && (!content.empty() || file || producer))
+    shared_content.reset();
+  if (!has_content_type)
+    headers.push_back(header{"Content-Type", "text/html"});
+  if (!has_content_length && !producer)
+    headers.push_back(header{"Content-Length", std::to_string(body_size())});
+  stock = nullptr;
+}
+
+void reply::serialize_header(std::string& out) const
+{
+  // A Date is required except on 1xx and 5xx replies, where it is optional.
+  // It is sent on 5xx replies as well, since the cached value costs nothing.
+  bool add_date = status >= 200;
+  std::string_view head = stock ? std::string_view(stock->header)
+    : std::string_view(status_strings::to_string(status));
+  std::size_t size = head.size() + sizeof(misc_strings::crlf);
+  for (const header& h: headers)
   {
-    header& h = headers[i];
-    buffers.push_back(asio::buffer(h.name));
-    buffers.push_back(asio::buffer(misc_strings::name_value_separator));
-    buffers.push_back(asio::buffer(h.value));
-    buffers.push_back(asio::buffer(misc_strings::crlf));
+    size += h.name.size() + sizeof(misc_strings::name_value_separator)
+      + h.value.size() + sizeof(misc_strings::crlf);
+    if (add_date && h.name.size() == 4
+        && boost::algorithm::iequals(h.name, "Date"))
+      add_date = false;
   }
-  buffers.push_back(asio::buffer(misc_strings::crlf));
-  buffers.push_back(asio::buffer(content));
+  std::string_view date;
+  if (add_date)
+  {
+    date = current_date();
+    size += sizeof(misc_strings::date) + date.size()
+      + sizeof(misc_strings::crlf);
+  }
+
+  // Size out once, then copy each piece straight into place. out normally
+  // has the room already, as it is reused from one reply to the next.
+  std::size_t offset = out.size();
+  out.resize(offset + size);
+  char* p = &out[offset];
+  auto put = [&p](const char* data, std::size_t length)
+    {
+      std::memcpy(p, data, length);
+      p += length;
+    };
+
+  put(head.data(), head.size());
+  if (add_date)
+  {
+    put(misc_strings::date, sizeof(misc_strings::date));
+    put(date.data(), date.size());
+    put(misc_strings::crlf, sizeof(misc_strings::crlf));
+  }
+  for (const header& h: headers)
+  {
+    put(h.name.data(), h.name.size());
+    put(misc_strings::name_value_separator,
+        sizeof(misc_strings::name_value_separator));
+    put(h.value.data(), h.value.size());
+    put(misc_strings::crlf, sizeof(misc_strings::crlf));
+  }
+  put(misc_strings::crlf, sizeof(misc_strings::crlf));
+}
+
+void reply::body_to_buffers(std::vector<asio::const_buffer>& buffers) const
+{
+  if (producer)
+    return;
+  if (!content.empty())
+    buffers.push_back(asio::buffer(content));
+  if (shared_content && !shared_content->empty())
+    buffers.push_back(asio::buffer(*shared_content));
+}
+
+std::vector<asio::const_buffer> reply::to_buffers(std::string& header) const
+{
+  header.clear();
+  serialize_header(header);
+  std::vector<asio::const_buffer> buffers;
+  buffers.reserve(3);
+  buffers.push_back(asio::buffer(header));
+  body_to_buffers(buffers);
   return buffers;
 }
 
@@ -174,6 +325,21 @@ const char not_found[] =
   "<head><title>Not Found</title></head>"
   "<body><h1>404 Not Found</h1></body>"
   "</html>";
+const char method_not_allowed[] =
+  "<html>"
+  "<head><title>Method Not Allowed</title></head>"
+  "<body><h1>405 Method Not Allowed</h1></body>"
+  "</html>";
+const char payload_too_large[] =
+  "<html>"
+  "<head><title>Payload Too Large</title></head>"
+  "<body><h1>413 Payload Too Large</h1></body>"
+  "</html>";
+const char request_header_fields_too_large[] =
+  "<html>"
+  "<head><title>Request Header Fields Too Large</title></head>"
+  "<body><h1>431 Request Header Fields Too Large</h1></body>"
+  "</html>";
 const char internal_server_error[] =
   "<html>"
   "<head><title>Internal Server Error</title></head>"
@@ -194,6 +360,11 @@ const char service_unavailable[] =
   "<head><title>Service Unavailable</title></head>"
   "<body><h1>503 Service Unavailable</h1></body>"
   "</html>";
+const char gateway_timeout[] =
+  "<html>"
+  "<head><title>Gateway Timeout</title></head>"
+  "<body><h1>504 Gateway Timeout</h1></body>"
+  "</html>";
 
 std::string to_string(reply::status_type status)
 {
@@ -223,6 +394,12 @@ std::string to_string(reply::status_type status)
     return forbidden;
   case reply::not_found:
     return not_found;
+  case reply::method_not_allowed:
+    return method_not_allowed;
+  case reply::payload_too_large:
+    return payload_too_large;
+  case reply::request_header_fields_too_large:
+    return request_header_fields_too_large;
   case reply::internal_server_error:
     return internal_server_error;
   case reply::not_implemented:
@@ -231,28 +408,84 @@ std::string to_string(reply::status_type status)
     return bad_gateway;
   case reply::service_unavailable:
     return service_unavailable;
+  case reply::gateway_timeout:
+    return gateway_timeout;
   default:
     return internal_server_error;
   }
 }
 
-} // namespace stock_replies
+/// Every status with a stock reply.
+const reply::status_type statuses[] =
+{
+  reply::ok,
+  reply::created,
+  reply::accepted,
+  reply::no_content,
+  reply::multiple_choices,
+  reply::moved_permanently,
+  reply::moved_temporarily,
+  reply::not_modified,
+  reply::bad_request,
+  reply::unauthorized,
+  reply::forbidden,
+  reply::not_found,
+  reply::method_not_allowed,
+  reply::payload_too_large,
+  reply::request_header_fields_too_large,
+  reply::internal_server_error,
+  reply::not_implemented,
+  reply::bad_gateway,
+  reply::service_unavailable,
+  reply::gateway_timeout,
+};
 
-reply reply::stock_reply(reply::status_type status)
+reply::stock_block make(reply::status_type status)
 {
-  reply rep;
-  rep.status = status;
-  rep.content = stock_replies::to_string(status);
+  reply::stock_block block;
+  block.status = status;
   /**
    * @brief 异常响应在返回体追加标识，便于调试时查看在哪一层返回404
    * @author stx
    */
-  rep.content += "by AsioHttpServer";
-  rep.headers.resize(2);
-  rep.headers[0].name = "Content-Length";
-  rep.headers[0].value = std::to_string(rep.content.size());
-  rep.headers[1].name = "Content-Type";
-  rep.headers[1].value = "text/html";
+  block.body = std::make_shared<const std::string>(
+      to_string(status) + "by AsioHttpServer");
+  block.header = status_strings::to_string(status);
+  block.header += "Content-Type: text/html\r\n";
+  block.header += "Content-Length: " + std::to_string(block.body->size())
+    + "\r\n";
+  return block;
+}
+
+} // namespace stock_replies
+
+reply reply::stock_reply(reply::status_type status)
+{
+  // Each stock reply is made once. Until a callback changes it, a copy only
+  // refers to the prebuilt body and header block; see detach_stock().
+  static const std::vector<reply::stock_block> blocks = []()
+    {
+      std::vector<reply::stock_block> made;
+      for (reply::status_type s: stock_replies::statuses)
+        made.push_back(stock_replies::make(s));
+      return made;
+    }();
+
+  // Statuses without a stock reply of their own get the 500 one, as their
+  // status line is that of 500 too.
+  const reply::stock_block* block = nullptr;
+  for (const reply::stock_block& b: blocks)
+  {
+    if (b.status == status)
+      block = &b;
+    else if (!block && b.status == reply::internal_server_error)
+      block = &b;
+  }
+
+  reply rep;
+  rep.status = block->status;
+  rep.shared_content = block->body;
+  rep.stock = block;
   return rep;
 }
 
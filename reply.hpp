@@ -11,6 +11,9 @@
 #ifndef HTTP_REPLY_HPP
 #define HTTP_REPLY_HPP
 
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include <asio.hpp>
@@ -19,6 +22,40 @@
 namespace http {
 namespace server {
 
+/// An open file to be sent as (the rest of) a reply body. The descriptor is
+/// closed when the last reply referring to it goes away.
+struct file_body
+{
+  file_body(const file_body&) = delete;
+  file_body& operator=(const file_body&) = delete;
+
+  /// Take ownership of an open file descriptor.
+  file_body(int fd, std::size_t size);
+
+  ~file_body();
+
+  /// The open file.
+  int fd;
+
+  /// Number of bytes to send, starting at offset 0.
+  std::size_t size;
+};
+
+/// Tells a connection that the producer of its streamed reply has more to
+/// send. May be called from any thread, any number of times; does nothing
+/// once the connection has moved on.
+typedef std::function<void()> body_resume;
+
+/// Produces a streamed reply body. Each call stores the next piece of the
+/// body in chunk (which is empty on entry) and returns false once that piece
+/// is the last one. The producer is only called again after the previous
+/// piece has been written to the socket. Returning true with an empty chunk
+/// means nothing is ready yet: the producer is then called again once resume
+/// has been called, which it may also do before returning. A connection left
+/// waiting for longer than options::write_timeout is closed.
+typedef std::function<bool(std::string& chunk, const body_resume& resume)>
+  body_producer;
+
 /// A reply to be sent to a client.
 struct reply
 {
@@ -37,24 +74,84 @@ struct reply
     unauthorized = 401,
     forbidden = 403,
     not_found = 404,
+    method_not_allowed = 405,
+    payload_too_large = 413,
+    request_header_fields_too_large = 431,
     internal_server_error = 500,
     not_implemented = 501,
     bad_gateway = 502,
-    service_unavailable = 503
+    service_unavailable = 503,
+    gateway_timeout = 504
   } status;
 
+  /// A stock reply as made once at startup: its body, and its status line
+  /// and fixed headers serialised into one block.
+  struct stock_block
+  {
+    status_type status;
+    std::shared_ptr<const std::string> body;
+    std::string header;
+  };
+
   /// The headers to be included in the reply.
   std::vector<header> headers;
 
   /// The content to be sent in the reply.
   std::string content;
 
-  /// Convert the reply into a vector of buffers. The buffers do not own the
-  /// underlying memory blocks, therefore the reply object must remain valid and
-  /// not be changed until the write operation has completed.
-  std::vector<asio::const_buffer> to_buffers();
+  /// Immutable content sent after content, shared with the file cache so
+  /// that cached files are not copied into every reply.
+  std::shared_ptr<const std::string> shared_content;
+
+  /// A file sent after content without being copied into user space
+  /// (sendfile on Linux). Null when the whole body is in memory.
+  std::shared_ptr<file_body> file;
+
+  /// Streamed body, sent as it is produced with chunked transfer-coding (or
+  /// until the connection closes, for HTTP/1.0 clients). When set it is the
+  /// whole body: content and shared content are not sent, and neither is a
+  /// Content-Length.
+  body_producer producer;
+
+  /// Set by the connection when producer output is sent chunked.
+  bool chunked = false;
+
+  /// The stock reply this reply still is, if any. Its status line and its
+  /// Content-Type and Content-Length are then sent from the prebuilt block,
+  /// followed by headers, and its body is shared_content.
+  const stock_block* stock = nullptr;
+
+  /// Size of the body: content, shared content and file.
+  std::size_t body_size() const
+  {
+    return content.size() + (shared_content ? shared_content->size() : 0)
+      + (file ? file->size : 0);
+  }
+
+  /// Turn a stock reply that has been changed since it was made, by a
+  /// callback changing its status or body or setting Content-Type or
+  /// Content-Length, into an ordinary reply with headers of its own. A body
+  /// set in content replaces the stock body.
+  void detach_stock();
+
+  /// Append the status line and headers, up to and including the blank line
+  /// that ends them, to out as one contiguous block. A Date header for the
+  /// current time is included unless the reply has one already.
+  void serialize_header(std::string& out) const;
+
+  /// Append buffers for the part of the body held in memory, content and
+  /// shared content, to buffers. The file body, if any, and the streamed body
+  /// are not included and must be sent afterwards.
+  void body_to_buffers(std::vector<asio::const_buffer>& buffers) const;
+
+  /// Convert the reply into a vector of buffers: the header, serialised into
+  /// header, followed by the body held in memory. The buffers do not own the
+  /// underlying memory blocks, therefore the reply object and header must
+  /// remain valid and not be changed until the write operation has completed.
+  std::vector<asio::const_buffer> to_buffers(std::string& header) const;
 
-  /// Get a stock reply.
+  /// Get a stock reply. It shares its body and header block with all other
+  /// stock replies with the same status, so making one does not allocate.
   static reply stock_reply(status_type status);
 };
 
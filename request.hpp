@@ -11,32 +11,91 @@
 #ifndef HTTP_REQUEST_HPP
 #define HTTP_REQUEST_HPP
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
-#include <map>
 #include "header.hpp"
+#include "url.hpp"
 
 namespace http {
 namespace server {
 
-/// A request received from a client.
-struct request
+/// A request received from a client. Allocator-aware, see basic_header; the
+/// request type passed to callbacks uses the default allocator.
+template <typename Allocator = std::allocator<char>>
+struct basic_request
 {
-  std::string method;
-  std::string uri;
-  int http_version_major;
-  int http_version_minor;
-  std::vector<header> headers;
+  typedef Allocator allocator_type;
+  typedef std::basic_string<char, std::char_traits<char>, Allocator>
+    string_type;
+  typedef basic_header<Allocator> header_type;
+  typedef std::vector<header_type,
+    typename std::allocator_traits<Allocator>::template
+      rebind_alloc<header_type>> header_list;
+  typedef std::map<string_type, string_type, std::less<string_type>,
+    typename std::allocator_traits<Allocator>::template
+      rebind_alloc<std::pair<const string_type, string_type>>> param_map;
+
+  basic_request() = default;
+  basic_request(const basic_request&) = default;
+  basic_request(basic_request&&) = default;
+  basic_request& operator=(const basic_request&) = default;
+  basic_request& operator=(basic_request&&) = default;
+
+  explicit basic_request(const Allocator& alloc)
+    : method(alloc), uri(alloc), headers(alloc), short_uri(alloc),
+      params(alloc), route_params(alloc), content(alloc)
+  {
+  }
+
+  allocator_type get_allocator() const { return method.get_allocator(); }
+
+  /// The text of uri after '?', still encoded, or empty if there is none.
+  /// Pass it to query_params to get every parameter, repeated keys included.
+  std::string_view query() const
+  {
+    std::string_view u(uri);
+    std::size_t q = u.find('?');
+    return q == std::string_view::npos
+      ? std::string_view() : u.substr(q + 1);
+  }
+
+  /// The parameters of query(), as views into uri that are decoded on
+  /// lookup. Valid until uri changes.
+  query_params query_args() const
+  {
+    query_params args;
+    args.parse(query());
+    return args;
+  }
+
+  string_type method;
+  string_type uri;
+  int http_version_major = 0;
+  int http_version_minor = 0;
+  header_list headers;
 
   /**
    * @brief 添加传递参数
    * @author stx
    */
-  std::string short_uri; // GET中去掉参数后的uri
-  std::map<std::string,std::string> params; // 参数列表，string-string的map
-  std::string content; // POST中body数据
+  string_type short_uri; // GET中去掉参数后的uri
+  param_map params; // 参数列表，string-string的map，见options::decode_params
+  param_map route_params; // 路由模式中捕获的参数，如/users/:id中的id
+  string_type content; // POST中body数据
 };
 
+typedef basic_request<> request;
+
+namespace pmr {
+typedef basic_request<std::pmr::polymorphic_allocator<char>> request;
+} // namespace pmr
+
 } // namespace server
 } // namespace http
 
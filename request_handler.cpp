@@ -9,30 +9,154 @@
 //
 
 #include "request_handler.hpp"
-#include <fstream>
-#include <sstream>
+#include <fcntl.h>
 #include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
 #include "mime_types.hpp"
 #include "reply.hpp"
 #include "request.hpp"
-#include <boost/algorithm/string.hpp>
-
-/**
- * @brief 对外暴露的响应回调
- * @author stx
- */
-void base_tsCallBack(http::server::request, http::server::reply&) {return;}
+#include "request_view.hpp"
+#include "url.hpp"
+#include "worker_pool.hpp"
 
 namespace http {
 namespace server {
 
-request_handler::request_handler(const std::string& doc_root)
-  : doc_root_(doc_root)
+namespace {
+
+header* find_header(std::vector<header>& headers, const char* name)
 {
-    pfunc_callback = base_tsCallBack;
+  for (auto& h: headers)
+  {
+    if (header_name_equals(h.name, name))
+      return &h;
+  }
+  return nullptr;
 }
 
-void request_handler::handle_request(const request& req, reply& rep)
+void set_header(std::vector<header>& headers, const char* name,
+    std::string_view value)
+{
+  if (header* h = find_header(headers, name))
+    h->value = value;
+  else
+    headers.push_back(header{name, value});
+}
+
+} // namespace
+
+request_handler::request_handler(asio::io_context& io_context,
+    const std::string& doc_root, const options& opts)
+  : io_context_(io_context),
+    doc_root_(doc_root),
+    file_cache_(opts.file_cache_bytes, opts.file_cache_max_file_bytes,
+        opts.file_cache_revalidate),
+    compression_(opts.compression),
+    compression_min_bytes_(opts.compression_min_bytes),
+    serve_precompressed_(opts.serve_precompressed),
+    decode_params_(opts.decode_params),
+    metrics_path_(opts.metrics_path)
+{
+}
+
+bool request_handler::handle_request(const request_view& req, reply& rep,
+    std::string* body, const defer_function& defer)
+{
+  if (metrics_ && req.known_method == method_get
+      && req.short_uri == metrics_path_)
+  {
+    rep.status = reply::ok;
+    metrics_->render(rep.content);
+    rep.headers.push_back(
+        header{"Content-Length", std::to_string(rep.content.size())});
+    rep.headers.push_back(
+        header{"Content-Type", "text/plain; version=0.0.4"});
+    return true;
+  }
+
+  // Registered routes are answered by their own handlers and never look at
+  // the document root.
+  router::match route;
+  bool routed = !router_.empty()
+    && router_.find(req.method, req.short_uri, route);
+  if (!routed && route.path_matched)
+  {
+    rep = reply::stock_reply(reply::method_not_allowed);
+    return true;
+  }
+
+  reply_state state;
+  if (!start_reply(req, rep, state, !routed))
+    return true;
+
+  // 触发回调
+  if (!routed && pfunc_async_callback)
+  {
+    request owned = req.to_owned(body, decode_params_);
+    pfunc_async_callback(owned, make_responder(std::move(state), defer()));
+    return false;
+  }
+
+  const request_callback* callback = routed ? route.target
+    : pfunc_callback ? &pfunc_callback : nullptr;
+  if (callback && worker_pool_)
+  {
+    // Run the callback on the pool and finish the reply here once it is
+    // done. If the pool is saturated the request is answered right away
+    // with 503, still in order with the other replies on the connection.
+    responder res = make_responder(std::move(state), defer());
+    bool queued = worker_pool_->post(
+        [callback = *callback, owned = make_request(req, body, route),
+         initial = std::move(rep), res]() mutable
+        {
+          callback(owned, initial);
+          res.send(std::move(initial));
+        });
+    if (!queued)
+      res.send(reply::stock_reply(reply::service_unavailable));
+    return false;
+  }
+
+  if (callback)
+  {
+    request owned = make_request(req, body, route);
+    (*callback)(owned, rep);
+  }
+  finish_reply(state, rep);
+  return true;
+}
+
+request request_handler::make_request(const request_view& req,
+    std::string* body, const router::match& route)
+{
+  request owned = req.to_owned(body, decode_params_);
+  for (std::size_t i = 0; i < route.capture_count; ++i)
+  {
+    // Decode each capture where it is stored, rather than through a
+    // temporary string.
+    auto it = owned.route_params.emplace(
+        std::string(route.captures[i].first), std::string()).first;
+    std::string& value = it->second;
+    value.assign(route.captures[i].second);
+    std::size_t size = url::decode_in_place(&value[0], value.size());
+    if (size == std::string::npos)
+      owned.route_params.erase(it);
+    else
+      value.resize(size);
+  }
+  return owned;
+}
+
+void request_handler::add_route(const std::string& method,
+    const std::string& pattern, request_callback callback)
+{
+  router_.add(method, pattern, std::move(callback));
+}
+
+bool request_handler::start_reply(const request_view& req, reply& rep,
+    reply_state& state, bool probe_files)
 {
   // Decode url to path.
   std::string request_path;
@@ -43,7 +167,7 @@ void request_handler::handle_request(const request& req, reply& rep)
   if (!url_decode(req.short_uri, request_path)) // 在传参数时使用short_uri而不是uri
   {
     rep = reply::stock_reply(reply::bad_request);
-    return;
+    return false;
   }
 
   // Request path must be absolute and not contain "..".
@@ -51,7 +175,7 @@ void request_handler::handle_request(const request& req, reply& rep)
       || request_path.find("..") != std::string::npos)
   {
     rep = reply::stock_reply(reply::bad_request);
-    return;
+    return false;
   }
 
   // If path ends in slash (i.e. is a directory) then add "index.html".
@@ -69,9 +193,40 @@ void request_handler::handle_request(const request& req, reply& rep)
     extension = request_path.substr(last_dot_pos + 1);
   }
 
-  // Open the file to send back.
+  // Work out which content codings the client accepts, best first. Only
+  // text-like types are worth compressing.
+  state.content_type = mime_types::extension_to_type(extension);
+  state.compressible = mime_types::is_compressible(state.content_type);
+  if (state.compressible)
+  {
+    if (const header_view* h = req.find_header(header_accept_encoding))
+      state.accepted_count = compression::negotiate(h->value, state.accepted);
+  }
+
+  if (!probe_files)
+  {
+    rep.status = reply::ok;
+    return true;
+  }
+
+  // Small files come from the cache. Others are opened but not read here:
+  // the connection sends them straight from the page cache. A precompressed
+  // sidecar (file.br, file.gz, ...) is preferred when the client accepts it.
   std::string full_path = doc_root_ + request_path;
-  std::ifstream is(full_path.c_str(), std::ios::in | std::ios::binary);
+  if (serve_precompressed_)
+  {
+    for (std::size_t i = 0; i < state.accepted_count; ++i)
+    {
+      if (open_file(full_path + compression::file_extension(state.accepted[i]),
+            extension, state.cached, state.file))
+      {
+        state.encoding = state.accepted[i];
+        break;
+      }
+    }
+  }
+  if (!state.cached && !state.file)
+    open_file(full_path, extension, state.cached, state.file);
   /**
    * @brief 404的逻辑修改
    * @details 由于asio的example默认从http doc path找返回体，而服务提供者不应每次都需要创建对应的文件并提供固定的返回值
@@ -80,7 +235,7 @@ void request_handler::handle_request(const request& req, reply& rep)
    *          如调用者不做任何判断与处理,无任何影响,正常返回404，回调只是提供一个重写404为正常返回的机会
    * @author stx
    */
-  if (!is)
+  if (!state.cached && !state.file)
   {
     rep = reply::stock_reply(reply::not_found);
     // return;
@@ -90,20 +245,70 @@ void request_handler::handle_request(const request& req, reply& rep)
       // 如不是404，响应文件存在，则检验完毕，返回200
       rep.status = reply::ok;
   }
+  return true;
+}
 
-  // 触发回调
-  pfunc_callback(req,rep);
+void request_handler::finish_reply(reply_state& state, reply& rep)
+{
+  rep.detach_stock();
 
   // Fill out the reply to be sent to the  client.
   // 如无doc的404被调用者手动置为200,返回体也应由调用者传递,否则返回默认的未被覆写的404内容
   if(rep.status == reply::ok)
   {
-      if(rep.content.empty())
+      if(rep.producer)
+      {
+          // Streamed replies are sent as produced: no file, no compression
+          // and no Content-Length.
+          state.encoding = compression::identity;
+      }
+      else if(rep.content.empty() && !rep.shared_content && !rep.file)
+      {
+          // 有文件返回体时才会追加内容，回调已填写content时不发送文件，防止内容混淆
+          if(state.cached)
+              rep.shared_content = state.cached->content;
+          else
+              rep.file = state.file;
+
+          // Compress cached files once and keep the result with the entry.
+          if(state.cached && state.encoding == compression::identity
+                  && compression_)
+          {
+              for(std::size_t i = 0; i < state.accepted_count; ++i)
+              {
+                  std::shared_ptr<const std::string> variant =
+                      compressed_variant(state.cached, state.accepted[i]);
+                  if(variant)
+                  {
+                      rep.shared_content = variant;
+                      state.encoding = state.accepted[i];
+                      break;
+                  }
+              }
+          }
+      }
+      else
       {
-          char buf[512];
-          // 有文件返回体时才会追加内容，注意content是append的，不应在响应_rep中重复添加返回内容，防止内容混淆 is.read()
-          while (is.read(buf, sizeof(buf)).gcount() > 0)
-            rep.content.append(buf, is.gcount());
+          // The callback supplied the body: compress it on the fly.
+          state.encoding = compression::identity;
+          if(compression_ && !rep.content.empty()
+                  && rep.content.size() >= compression_min_bytes_
+                  && !rep.shared_content && !rep.file
+                  && !find_header(rep.headers, "Content-Encoding"))
+          {
+              for(std::size_t i = 0; i < state.accepted_count; ++i)
+              {
+                  std::string compressed;
+                  if(compression::compress(state.accepted[i], rep.content,
+                              compressed)
+                          && compressed.size() < rep.content.size())
+                  {
+                      rep.content.swap(compressed);
+                      state.encoding = state.accepted[i];
+                      break;
+                  }
+              }
+          }
       }
 
       /// @brief bugsolved
@@ -111,69 +316,102 @@ void request_handler::handle_request(const request& req, reply& rep)
       ///        如直接添加，response在!is被置404后又被回调置200时会重复添加
       ///        如直接resize(2)，则上层应用填写的Date等http头会被删除
       /// @todo  应用是否有必要/有权限修改http headers
-      int is_content_length = -1;
-      int is_content_type = -1;
+      /// @brief rep.value是stdstring,直接赋size值会导致赋值为char的对应字符
+      if(!rep.producer)
+          set_header(rep.headers, "Content-Length",
+              std::to_string(rep.body_size()));
+      set_header(rep.headers, "Content-Type",
+          state.cached ? state.cached->content_type : state.content_type);
+      if(state.encoding != compression::identity)
+          set_header(rep.headers, "Content-Encoding",
+              compression::content_encoding(state.encoding));
+      // The representation depends on Accept-Encoding, so caches must keep
+      // the variants apart.
+      if(state.compressible && !find_header(rep.headers, "Vary"))
+          rep.headers.push_back(header{"Vary", "Accept-Encoding"});
+
+      //extension 截取uri的.后面部分,为/log.html在mime_types里添加charset
+  }
+}
 
-      for(uint i=0;i<rep.headers.size();i++)
+responder request_handler::make_responder(reply_state&& state,
+    responder::deliver_function deliver)
+{
+  auto shared_state = std::make_shared<reply_state>(std::move(state));
+  return responder(
+      [this, shared_state, deliver](reply&& rep)
       {
-          if(boost::algorithm::iequals(rep.headers[i].name, "content-length"))
-              is_content_length = i;
-          if(boost::algorithm::iequals(rep.headers[i].name, "Content-Type"))
-              is_content_type = i;
-      }
+        asio::post(io_context_,
+            [this, shared_state, deliver, rep = std::move(rep)]() mutable
+            {
+              finish_reply(*shared_state, rep);
+              deliver(std::move(rep));
+            });
+      });
+}
 
-      /// @brief rep.value是stdstring,直接赋size值会导致赋值为char的对应字符
-      if(is_content_length >= 0)
-          rep.headers[is_content_length].value = std::to_string(rep.content.size());
-      else
-          rep.headers.push_back(header{"Content-Length",std::to_string(rep.content.size())});
+body_reader request_handler::open_body(const request_view& req) const
+{
+  if (!pfunc_body_handler)
+    return body_reader();
+  return pfunc_body_handler(req);
+}
 
-      if(is_content_type >= 0)
-          rep.headers[is_content_type].value = mime_types::extension_to_type(extension);
-      else
-          rep.headers.push_back(header{"Content-Type",mime_types::extension_to_type(extension)});
+bool request_handler::open_file(const std::string& path,
+    const std::string& extension, file_cache::entry_ptr& cached,
+    std::shared_ptr<file_body>& file)
+{
+  file_cache::uncached_file uncached;
+  cached = file_cache_.get(path, extension, uncached);
+  if (cached)
+    return true;
+  if (uncached.fd >= 0)
+  {
+    file = std::make_shared<file_body>(uncached.fd, uncached.size);
+    return true;
+  }
+  if (file_cache_.missing(path))
+    return false;
 
-      //extension 截取uri的.后面部分,为/log.html在mime_types里添加charset
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+  {
+    ::close(fd);
+    return false;
   }
+  file = std::make_shared<file_body>(fd, static_cast<std::size_t>(st.st_size));
+  return true;
 }
 
-bool request_handler::url_decode(const std::string& in, std::string& out)
+std::shared_ptr<const std::string> request_handler::compressed_variant(
+    const file_cache::entry_ptr& cached, compression::encoding encoding)
 {
-  out.clear();
-  out.reserve(in.size());
-  for (std::size_t i = 0; i < in.size(); ++i)
+  if (!compression::available(encoding)
+      || cached->content->size() < compression_min_bytes_)
+    return std::shared_ptr<const std::string>();
+
+  std::shared_ptr<const std::string> variant = cached->compressed[encoding];
+  if (!variant)
   {
-    if (in[i] == '%')
-    {
-      if (i + 3 <= in.size())
-      {
-        int value = 0;
-        std::istringstream is(in.substr(i + 1, 2));
-        if (is >> std::hex >> value)
-        {
-          out += static_cast<char>(value);
-          i += 2;
-        }
-        else
-        {
-          return false;
-        }
-      }
-      else
-      {
-        return false;
-      }
-    }
-    else if (in[i] == '+')
-    {
-      out += ' ';
-    }
+    auto compressed = std::make_shared<std::string>();
+    if (compression::compress(encoding, *cached->content, *compressed,
+          compression::best) && compressed->size() < cached->content->size())
+      variant = compressed;
     else
-    {
-      out += in[i];
-    }
+      variant = cached->content;
+    file_cache_.add_variant(cached, encoding, variant);
   }
-  return true;
+  if (variant == cached->content)
+    return std::shared_ptr<const std::string>();
+  return variant;
+}
+
+bool request_handler::url_decode(std::string_view in, std::string& out)
+{
+  return url::decode(in, out);
 }
 
 } // namespace server
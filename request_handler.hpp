@@ -11,13 +11,35 @@
 #ifndef HTTP_REQUEST_HANDLER_HPP
 #define HTTP_REQUEST_HANDLER_HPP
 
+#include <asio.hpp>
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
+#include "compression.hpp"
+#include "file_cache.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+#include "reply.hpp"
+#include "request.hpp"
+#include "request_view.hpp"
+#include "responder.hpp"
+#include "router.hpp"
 
 namespace http {
 namespace server {
 
-struct reply;
-struct request;
+class worker_pool;
+
+/// The user callback invoked for every request. It may move out of the
+/// request, which is not used again once the callback returns.
+typedef std::function<void(request& req, reply& rep)> request_callback;
+
+/// A user callback that answers later, possibly from another thread, by
+/// calling res.send(). The reply it sends is finished like a synchronous one:
+/// status ok with no body serves the requested file if there is one.
+typedef std::function<void(request& req, responder res)>
+  async_request_callback;
 
 /// The common handler for all incoming requests.
 class request_handler
@@ -26,22 +48,125 @@ public:
   request_handler(const request_handler&) = delete;
   request_handler& operator=(const request_handler&) = delete;
 
-  /// Construct with a directory containing files to be served.
-  explicit request_handler(const std::string& doc_root);
+  /// Construct with a directory containing files to be served. Deferred
+  /// replies are finished on the given io_context.
+  request_handler(asio::io_context& io_context, const std::string& doc_root,
+      const options& opts = options());
+
+  /// Called when a reply is deferred, to get the function that queues the
+  /// finished reply on the connection. That function is called on the
+  /// io_context's thread.
+  typedef std::function<responder::deliver_function()> defer_function;
+
+  /// Handle a request and produce a reply. The callback receives an owning
+  /// copy of the request made with request_view::to_owned(); if body is
+  /// given it holds the request body, which is moved into that copy. Returns
+  /// false if the reply is deferred, because the callback is asynchronous or
+  /// runs on the worker pool; it is then finished later and passed to the
+  /// function returned by defer.
+  bool handle_request(const request_view& req, reply& rep, std::string* body,
+      const defer_function& defer);
+
+  /// Route requests for method and pattern to callback instead of the
+  /// document root and pfunc_callback; see router for the pattern syntax.
+  /// The callback finds the captured values in request::route_params.
+  void add_route(const std::string& method, const std::string& pattern,
+      request_callback callback);
+
+  /// Run synchronous callbacks on the given pool instead of the io_context's
+  /// thread. Null runs them inline.
+  void set_worker_pool(worker_pool* pool) { worker_pool_ = pool; }
+
+  /// Serve the given metrics at options::metrics_path. Null disables it.
+  void set_metrics(const metrics_registry* metrics) { metrics_ = metrics; }
 
-  /// Handle a request and produce a reply.
-  void handle_request(const request& req, reply& rep);
+  /// Choose how the body of a request is received, see body_handler.
+  /// Returns an empty reader unless a body handler is set.
+  body_reader open_body(const request_view& req) const;
 
-  /// 回调指针
-  void (*pfunc_callback) (http::server::request, http::server::reply&);
+  /// Perform URL-decoding on a string. Returns false if the encoding was
+  /// invalid.
+  static bool url_decode(std::string_view in, std::string& out);
+
+  /// 回调，未设置时不调用
+  request_callback pfunc_callback;
+
+  /// Asynchronous callback, used instead of pfunc_callback when set.
+  async_request_callback pfunc_async_callback;
+
+  /// Optional handler deciding which request bodies are streamed.
+  body_handler pfunc_body_handler;
 
 private:
+  /// What is known about a request before the callback runs, needed to
+  /// finish its reply afterwards.
+  struct reply_state
+  {
+    file_cache::entry_ptr cached;
+    std::shared_ptr<file_body> file;
+    compression::encoding encoding = compression::identity;
+    compression::encoding accepted[compression::encoding_count];
+    std::size_t accepted_count = 0;
+    bool compressible = false;
+    std::string_view content_type;
+  };
+
+  /// Look up the file for a request and set up the initial reply: 200 if
+  /// the file exists, 404 if not, or always 200 without looking when
+  /// probe_files is false. Returns false if the request is invalid, in which
+  /// case rep is the final reply.
+  bool start_reply(const request_view& req, reply& rep, reply_state& state,
+      bool probe_files);
+
+  /// The owning request passed to a callback, with the route's captures.
+  request make_request(const request_view& req, std::string* body,
+      const router::match& route);
+
+  /// Attach the file body, compress and set the entity headers once the
+  /// callback has filled in the reply.
+  void finish_reply(reply_state& state, reply& rep);
+
+  /// Create a responder that finishes its reply on the io_context and then
+  /// passes it to deliver.
+  responder make_responder(reply_state&& state,
+      responder::deliver_function deliver);
+
+  /// The io_context on which deferred replies are finished.
+  asio::io_context& io_context_;
+
+  /// Routes registered with add_route().
+  router router_;
+
+  /// Pool running synchronous callbacks, if any.
+  worker_pool* worker_pool_ = nullptr;
+
   /// The directory containing the files to be served.
   std::string doc_root_;
 
-  /// Perform URL-decoding on a string. Returns false if the encoding was
-  /// invalid.
-  static bool url_decode(const std::string& in, std::string& out);
+  /// Cache of small, frequently requested files.
+  file_cache file_cache_;
+
+  /// Compression settings, see options.
+  bool compression_;
+  std::size_t compression_min_bytes_;
+  bool serve_precompressed_;
+
+  /// Whether callbacks get request::params filled in, see options.
+  bool decode_params_;
+
+  /// The metrics served at metrics_path_, if any.
+  const metrics_registry* metrics_ = nullptr;
+  std::string metrics_path_;
+
+  /// Find the file at path, in the cache or on disk. Returns false if it does
+  /// not exist or is not a regular file.
+  bool open_file(const std::string& path, const std::string& extension,
+      file_cache::entry_ptr& cached, std::shared_ptr<file_body>& file);
+
+  /// The compressed form of a cached file, created on first use. Returns null
+  /// if the encoding is unavailable or does not make the file smaller.
+  std::shared_ptr<const std::string> compressed_variant(
+      const file_cache::entry_ptr& cached, compression::encoding encoding);
 };
 
 } // namespace server
@@ -9,12 +9,51 @@
 //
 
 #include "request_parser.hpp"
-#include "request.hpp"
+#include <algorithm>
+#include <cstring>
+#include "char_scan.hpp"
+#include "url.hpp"
 
-#include <boost/algorithm/string.hpp>
 namespace http {
 namespace server {
 
+namespace {
+
+/// Character classes, indexed by byte value. Bytes above 127 belong to no
+/// class, which matches the original checks for a sign-extended char.
+enum char_class
+{
+  class_char = 1,
+  class_ctl = 2,
+  class_tspecial = 4
+};
+
+struct char_class_table
+{
+  unsigned char classes[256];
+
+  constexpr char_class_table()
+    : classes()
+  {
+    for (int c = 0; c <= 127; ++c)
+      classes[c] = class_char;
+    for (int c = 0; c <= 31; ++c)
+      classes[c] |= class_ctl;
+    classes[127] |= class_ctl;
+    for (const char* p = "()<>@,;:\\\"/[]?={} \t"; *p; ++p)
+      classes[static_cast<unsigned char>(*p)] |= class_tspecial;
+  }
+};
+
+constexpr char_class_table char_classes;
+
+inline unsigned char char_class_of(int c)
+{
+  return char_classes.classes[static_cast<unsigned char>(c)];
+}
+
+} // namespace
+
 request_parser::request_parser()
   : state_(method_start)
 {
@@ -25,7 +64,149 @@ void request_parser::reset()
   state_ = method_start;
 }
 
-request_parser::result_type request_parser::consume(request& req, char input)
+template <typename Request>
+std::tuple<request_parser::result_type, const char*> request_parser::parse(
+    request_view& view, Request& storage, const char* begin, const char* end)
+{
+  view.clear();
+  const char* next = parse_contiguous(view, begin, end);
+  if (next != nullptr)
+    return std::make_tuple(good, next);
+
+  // The fast path gives up on incomplete headers; wait for the rest before
+  // doing anything more expensive.
+  static const char terminator[] = "\r\n\r\n";
+  if (std::search(begin, end, terminator, terminator + 4) == end)
+    return std::make_tuple(indeterminate, begin);
+
+  // The header is complete but unusual or invalid, so let the state machine
+  // decide, keeping the fields in storage.
+  storage = Request(storage.get_allocator());
+  state_ = method_start;
+  const char* p = begin;
+  while (p != end)
+  {
+    result_type result = consume(storage, *p++);
+    if (result == good)
+    {
+      view.assign(storage);
+      return std::make_tuple(good, p);
+    }
+    if (result == bad)
+      return std::make_tuple(bad, p);
+  }
+  state_ = method_start;
+  return std::make_tuple(indeterminate, begin);
+}
+
+template <typename Request>
+void request_parser::copy_view(const request_view& view, Request& req)
+{
+  req.method.assign(view.method.data(), view.method.size());
+  req.uri.assign(view.uri.data(), view.uri.size());
+  req.http_version_major = view.http_version_major;
+  req.http_version_minor = view.http_version_minor;
+  req.headers.resize(view.headers.size());
+  for (std::size_t i = 0; i < view.headers.size(); ++i)
+  {
+    req.headers[i].name.assign(
+        view.headers[i].name.data(), view.headers[i].name.size());
+    req.headers[i].value.assign(
+        view.headers[i].value.data(), view.headers[i].value.size());
+  }
+}
+
+const char* request_parser::parse_contiguous(request_view& req,
+    const char* begin, const char* end)
+{
+  req.headers.clear();
+
+  // Method: a non-empty token followed by a space.
+  const char* p = begin;
+  while (p != end && is_token(*p))
+    ++p;
+  if (p == begin || p == end || *p != ' ')
+    return nullptr;
+  const char* method_end = p;
+
+  // URI: everything up to the next space, without control characters.
+  const char* uri_begin = method_end + 1;
+  const char* uri_end = char_scan::find_ctl_or(uri_begin, end, ' ');
+  if (uri_end == end || *uri_end != ' ')
+    return nullptr;
+
+  // Version: "HTTP/" major "." minor CRLF.
+  p = uri_end + 1;
+  if (end - p < 5 || std::memcmp(p, "HTTP/", 5) != 0)
+    return nullptr;
+  p += 5;
+  int major = 0;
+  if (p == end || !is_digit(*p))
+    return nullptr;
+  while (p != end && is_digit(*p))
+    major = major * 10 + *p++ - '0';
+  if (p == end || *p != '.')
+    return nullptr;
+  ++p;
+  int minor = 0;
+  if (p == end || !is_digit(*p))
+    return nullptr;
+  while (p != end && is_digit(*p))
+    minor = minor * 10 + *p++ - '0';
+  if (end - p < 2 || p[0] != '\r' || p[1] != '\n')
+    return nullptr;
+  p += 2;
+
+  // Headers: "name: value" CRLF, terminated by an empty line. Continuation
+  // lines start with a space or tab, which is not a token character, so they
+  // fall back to the state machine.
+  for (;;)
+  {
+    if (p == end)
+      break;
+    if (*p == '\r')
+    {
+      if (end - p < 2 || p[1] != '\n')
+        break;
+      req.method = std::string_view(begin, method_end - begin);
+      req.uri = std::string_view(uri_begin, uri_end - uri_begin);
+      req.http_version_major = major;
+      req.http_version_minor = minor;
+      req.split_uri();
+      req.index();
+      state_ = expecting_newline_3;
+      return p + 2;
+    }
+
+    const char* name_end = char_scan::find_ctl_or(p, end, ':');
+    if (name_end == end || name_end == p || *name_end != ':')
+      break;
+    const char* q = p;
+    while (q != name_end && is_token(*q))
+      ++q;
+    if (q != name_end)
+      break;
+
+    const char* value_begin = name_end + 1;
+    if (value_begin == end || *value_begin != ' ')
+      break;
+    ++value_begin;
+    const char* value_end = char_scan::find_ctl_or(value_begin, end, '\x7f');
+    if (end - value_end < 2 || value_end[0] != '\r' || value_end[1] != '\n')
+      break;
+
+    req.headers.push_back(header_view{
+        std::string_view(p, name_end - p),
+        std::string_view(value_begin, value_end - value_begin)});
+    p = value_end + 2;
+  }
+
+  req.headers.clear();
+  return nullptr;
+}
+
+template <typename Request>
+request_parser::result_type request_parser::consume(Request& req, char input)
 {
   switch (state_)
   {
@@ -201,7 +382,7 @@ request_parser::result_type request_parser::consume(request& req, char input)
     }
     else
     {
-      req.headers.push_back(header());
+      req.headers.emplace_back();
       req.headers.back().name.push_back(input);
       state_ = header_name;
       return indeterminate;
@@ -290,85 +471,22 @@ bool request_parser::is_char(int c)
 
 bool request_parser::is_ctl(int c)
 {
-  return (c >= 0 && c <= 31) || (c == 127);
+  return c >= -128 && c <= 255 && (char_class_of(c) & class_ctl) != 0;
 }
 
 bool request_parser::is_tspecial(int c)
 {
-  switch (c)
-  {
-  case '(': case ')': case '<': case '>': case '@':
-  case ',': case ';': case ':': case '\\': case '"':
-  case '/': case '[': case ']': case '?': case '=':
-  case '{': case '}': case ' ': case '\t':
-    return true;
-  default:
-    return false;
-  }
-}
-
-bool request_parser::is_digit(int c)
-{
-  return c >= '0' && c <= '9';
-}
-
-/**
- * @brief 编码用函数
- * @author stx
- */
-int hex2int(char ch)
-{
-    if(48 <= ch && ch <= 57) // 0-9
-        return ch - 48;
-    else if(65 <= ch && ch <= 70) // A-F
-        return ch - 65 + 10;
-    else if(97 <= ch && ch <= 102) // a-f
-        return ch - 97 + 10;
-    return -1;
+  return c >= -128 && c <= 255 && (char_class_of(c) & class_tspecial) != 0;
 }
 
-/**
- * @brief 编码用函数
- * @author stx
- */
-int hex2int(std::string str)
+bool request_parser::is_token(int c)
 {
-    if(str.size()!=2)
-        return -2;
-    char ch_high = str.at(0);
-    char ch_low = str.at(1);
-    int high = hex2int(ch_high)*16;
-    int low = hex2int(ch_low);
-    return high+low;
+  return c >= -128 && c <= 255 && char_class_of(c) == class_char;
 }
 
-/**
- * @brief 编码用函数
- * @author stx
- * @brief bugsolved 参数="汉":"字"
- *      para : str="汉":"字"
- *                ="%22%E6%B1%89%22:%22%E5%AD%97%22"
- *      split: %22:%22 -> [%22:]
- *      ':' 被分在%22组中,%22:四个字符被视为一个整体
- */
-std::string utf8_zh_decode(std::string str)
+bool request_parser::is_digit(int c)
 {
-    if(str.empty()) return "";
-    std::vector<std::string> split_zh_temp;
-    boost::split(split_zh_temp,str, boost::is_any_of("%"));
-    std::string zh_result;
-    for(uint i=1;i<split_zh_temp.size();i++)
-    {
-        if(split_zh_temp.at(i).size()<2)
-        {
-            zh_result += '%'; // 补上被分割的%
-            zh_result += split_zh_temp.at(i).substr(0,-1); // 短于两字符不处理
-            continue;
-        }
-        zh_result += hex2int(split_zh_temp.at(i).substr(0,2)); // 前两字符转ASCII
-        zh_result += split_zh_temp.at(i).substr(2,-1); // 两字符以后的字符原样添加
-    }
-    return zh_result;
+  return c >= '0' && c <= '9';
 }
 
 /**
@@ -379,40 +497,38 @@ std::string utf8_zh_decode(std::string str)
 void request_parser::parse_param(request &req)
 {
     // for GET
-    int index = req.uri.find_first_of("?");
-    if(index >= 0)
+    std::size_t index = req.uri.find('?');
+    if (index == std::string::npos)
     {
-        // todo 如果?是最后一个字符好像会溢出
-        // split origin uri
-        req.short_uri = req.uri.substr(0, index);
-        std::string param_str = req.uri.substr(index + 1, req.uri.size());
+        req.short_uri = req.uri;
+        return;
+    }
 
-        std::vector<std::string> split_result;
-        boost::split(split_result, param_str, boost::is_any_of("&"));
+    req.short_uri.assign(req.uri, 0, index);
 
-        for(uint i=0; i<split_result.size(); i++)
+    // Keys and values are decoded whether or not they begin with '%', so
+    // mixed text such as "a%20b" decodes too. The map keeps the first of
+    // repeated keys; query_params gives all of them.
+    std::string key, value;
+    query_params::split(std::string_view(req.uri).substr(index + 1),
+        [&](std::string_view k, std::string_view v)
         {
-            std::vector<std::string> split_result_temp;
-            boost::split(split_result_temp,split_result.at(i), boost::is_any_of("="));
-            if(split_result_temp.size() >= 2)
-            {
-//                req.params.push_back(header());
-//                req.params.back().name = ;
-//                req.params.back().value = ; // change vector<head> to map<string,string>
-                //解决中文UTF8转码问题 %E6%B1%89 = [0xe6,0xb1,0x89] = "汉"
-                if(!split_result_temp.at(0).empty() && split_result_temp.at(0).at(0)=='%')
-                    split_result_temp.at(0) = utf8_zh_decode(split_result_temp.at(0));
-                if(!split_result_temp.at(1).empty() && split_result_temp.at(1).at(0)=='%')
-                    split_result_temp.at(1) = utf8_zh_decode(split_result_temp.at(1));
-                req.params.insert(make_pair(split_result_temp.at(0),split_result_temp.at(1)));
-            }
-        }
-    }
-    else
-    {
-        req.short_uri = req.uri;
-    }
+            url::decode_lenient(k, key);
+            url::decode_lenient(v, value);
+            req.params.emplace(key, value);
+        });
 }
 
+// The parser is used with the default and the arena-allocated request types.
+template std::tuple<request_parser::result_type, const char*>
+request_parser::parse(request_view&, request&, const char*, const char*);
+template std::tuple<request_parser::result_type, const char*>
+request_parser::parse(request_view&, pmr::request&, const char*, const char*);
+template void request_parser::copy_view(const request_view&, request&);
+template void request_parser::copy_view(const request_view&, pmr::request&);
+template request_parser::result_type request_parser::consume(request&, char);
+template request_parser::result_type request_parser::consume(
+    pmr::request&, char);
+
 } // namespace server
 } // namespace http
@@ -12,12 +12,13 @@
 #define HTTP_REQUEST_PARSER_HPP
 
 #include <tuple>
+#include <type_traits>
+#include "request.hpp"
+#include "request_view.hpp"
 
 namespace http {
 namespace server {
 
-struct request;
-
 /// Parser for incoming requests.
 class request_parser
 {
@@ -35,10 +36,28 @@ public:
   /// been parsed, bad if the data is invalid, indeterminate when more data is
   /// required. The InputIterator return value indicates how much of the input
   /// has been consumed.
-  template <typename InputIterator>
-  std::tuple<result_type, InputIterator> parse(request& req,
+  template <typename Request, typename InputIterator>
+  std::tuple<result_type, InputIterator> parse(Request& req,
       InputIterator begin, InputIterator end)
   {
+    // When a whole request header sits in one contiguous buffer it is parsed
+    // by the vectorised fast path; anything else (a header spanning several
+    // reads, continuation lines, invalid input) goes through the state
+    // machine below.
+    if constexpr (std::is_convertible<InputIterator, const char*>::value)
+    {
+      if (state_ == method_start && begin != end && req.method.empty()
+          && req.uri.empty() && req.headers.empty())
+      {
+        const char* next = parse_contiguous(scratch_, begin, end);
+        if (next != nullptr)
+        {
+          copy_view(scratch_, req);
+          return std::make_tuple(good, begin + (next - &*begin));
+        }
+      }
+    }
+
     while (begin != end)
     {
       result_type result = consume(req, *begin++);
@@ -48,11 +67,34 @@ public:
     return std::make_tuple(indeterminate, begin);
   }
 
+  /// Parse a request header held in the contiguous buffer [begin, end)
+  /// without copying it: the fields of view refer into the buffer. When the
+  /// header cannot be referenced in place (continuation lines) it is parsed
+  /// into storage and view refers to that instead. Returns indeterminate,
+  /// with nothing consumed, while the header is incomplete; the caller must
+  /// call again with the same data plus whatever arrives next.
+  template <typename Request>
+  std::tuple<result_type, const char*> parse(request_view& view,
+      Request& storage, const char* begin, const char* end);
+
   /// 参数解析
-  void parse_param(request& req);
+  static void parse_param(request& req);
 private:
-  /// Handle the next character of input.
-  result_type consume(request& req, char input);
+  /// Parse a complete request header held in [begin, end) into views over
+  /// that memory. Returns the position just past the header on success, or
+  /// null (with the parser state untouched) when the header is incomplete or
+  /// anything unusual is found, in which case the state machine must be used.
+  const char* parse_contiguous(request_view& req,
+      const char* begin, const char* end);
+
+  /// Copy the fields of a parsed view into an owning request.
+  template <typename Request>
+  static void copy_view(const request_view& view, Request& req);
+
+  /// Handle the next character of input. The request types it is used with
+  /// are instantiated in request_parser.cpp.
+  template <typename Request>
+  result_type consume(Request& req, char input);
 
   /// Check if a byte is an HTTP character.
   static bool is_char(int c);
@@ -66,6 +108,9 @@ private:
   /// Check if a byte is a digit.
   static bool is_digit(int c);
 
+  /// Check if a byte may appear in a token (method or header name).
+  static bool is_token(int c);
+
   /// The current state of the parser.
   enum state
   {
@@ -90,6 +135,9 @@ private:
     expecting_newline_2,
     expecting_newline_3
   } state_;
+
+  /// Scratch view used by the fast path when parsing into an owning request.
+  request_view scratch_;
 };
 
 } // namespace server
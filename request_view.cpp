@@ -0,0 +1,110 @@
+//
+// request_view.cpp
+// ~~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "request_view.hpp"
+#include <utility>
+#include "request_parser.hpp"
+
+namespace http {
+namespace server {
+
+void request_view::clear()
+{
+  method = std::string_view();
+  uri = std::string_view();
+  http_version_major = 0;
+  http_version_minor = 0;
+  headers.clear();
+  short_uri = std::string_view();
+  query = std::string_view();
+  content = std::string_view();
+  known_method = method_other;
+  header_positions.clear();
+}
+
+void request_view::index()
+{
+  known_method = classify_method(method);
+  header_positions.build(headers);
+}
+
+template <typename Request>
+void request_view::assign(const Request& req)
+{
+  method = req.method;
+  uri = req.uri;
+  http_version_major = req.http_version_major;
+  http_version_minor = req.http_version_minor;
+  headers.clear();
+  for (auto& h: req.headers)
+    headers.push_back(header_view{h.name, h.value});
+  content = req.content;
+  split_uri();
+  index();
+}
+
+void request_view::split_uri()
+{
+  std::size_t index = uri.find('?');
+  if (index != std::string_view::npos)
+  {
+    short_uri = uri.substr(0, index);
+    query = uri.substr(index + 1);
+  }
+  else
+  {
+    short_uri = uri;
+    query = std::string_view();
+  }
+}
+
+template <typename Request>
+void request_view::keep(Request& storage)
+{
+  // Build the copy separately: the view may refer into storage itself.
+  Request copy(storage.get_allocator());
+  copy.method.assign(method.data(), method.size());
+  copy.uri.assign(uri.data(), uri.size());
+  copy.http_version_major = http_version_major;
+  copy.http_version_minor = http_version_minor;
+  copy.headers.reserve(headers.size());
+  for (auto& h: headers)
+    copy.headers.emplace_back(h.name, h.value);
+  copy.content.assign(content.data(), content.size());
+  storage = std::move(copy);
+  assign(storage);
+}
+
+template void request_view::assign(const request&);
+template void request_view::assign(const pmr::request&);
+template void request_view::keep(request&);
+template void request_view::keep(pmr::request&);
+
+request request_view::to_owned(std::string* body, bool decode_params) const
+{
+  request req;
+  req.method.assign(method.data(), method.size());
+  req.uri.assign(uri.data(), uri.size());
+  req.http_version_major = http_version_major;
+  req.http_version_minor = http_version_minor;
+  req.headers.reserve(headers.size());
+  for (auto& h: headers)
+    req.headers.push_back(header{std::string(h.name), std::string(h.value)});
+  if (body)
+    req.content = std::move(*body);
+  else
+    req.content.assign(content.data(), content.size());
+  if (decode_params)
+    request_parser::parse_param(req);
+  else
+    req.short_uri.assign(short_uri.data(), short_uri.size());
+  return req;
+}
+
+} // namespace server
+} // namespace http
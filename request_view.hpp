@@ -0,0 +1,100 @@
+//
+// request_view.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_REQUEST_VIEW_HPP
+#define HTTP_REQUEST_VIEW_HPP
+
+#include <functional>
+#include <string_view>
+#include <vector>
+#include "header_index.hpp"
+#include "request.hpp"
+
+namespace http {
+namespace server {
+
+/// A request whose fields refer to memory owned by someone else, normally the
+/// connection's receive buffer. The referenced memory is only guaranteed to
+/// stay valid while the request is being handled; use to_owned() to keep any
+/// of it longer.
+struct request_view
+{
+  std::string_view method;
+  std::string_view uri;
+  int http_version_major = 0;
+  int http_version_minor = 0;
+  std::vector<header_view> headers;
+
+  std::string_view short_uri; // uri without the query string
+  std::string_view query; // text after '?', empty if there is none
+  std::string_view content; // request body
+
+  /// The method, if it is one the parser recognises.
+  method_id known_method = method_other;
+
+  /// Finds headers by name, built by index().
+  header_index header_positions;
+
+  /// Reset all fields. The header storage is kept for the next request.
+  void clear();
+
+  /// Classify the method and index the headers, once they are all parsed.
+  void index();
+
+  /// The first header with a recognised name, or null.
+  const header_view* find_header(header_id id) const
+  {
+    std::size_t i = header_positions.find(id);
+    return i == header_index::npos ? nullptr : &headers[i];
+  }
+
+  /// The first header with the given name, ignoring case, or null.
+  const header_view* find_header(std::string_view name) const
+  {
+    std::size_t i = header_positions.find(name, headers);
+    return i == header_index::npos ? nullptr : &headers[i];
+  }
+
+  /// Point the view at the fields of an owning request, of either request
+  /// type.
+  template <typename Request>
+  void assign(const Request& req);
+
+  /// Copy the fields into storage and point the view at the copies, so that
+  /// they outlive the memory the view referred to. storage may be what the
+  /// view already refers to.
+  template <typename Request>
+  void keep(Request& storage);
+
+  /// Split uri into short_uri and query.
+  void split_uri();
+
+  /// Copy the request into an owning request, with params decoded if
+  /// decode_params is set. When body is given, the content is moved out of
+  /// it instead of copied from content; it must hold the same bytes.
+  request to_owned(std::string* body = nullptr,
+      bool decode_params = true) const;
+};
+
+/// Receives a request body piece by piece, in order, as it arrives. Each piece
+/// refers into the receive buffer and is only valid during the call.
+typedef std::function<void(std::string_view data)> body_reader;
+
+/// Called once the header of a request with a body has been parsed, before
+/// any of the body is read. Return a reader to have the body streamed to it;
+/// the request is then handled as usual once the whole body has been passed
+/// on, with empty content. Return an empty reader to receive the whole body
+/// in content instead, which is limited to options::max_request_body_bytes.
+/// If the connection closes first, the reader is destroyed without the
+/// request being handled.
+typedef std::function<body_reader(const request_view& req)> body_handler;
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_REQUEST_VIEW_HPP
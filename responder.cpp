@@ -0,0 +1,43 @@
+//
+// responder.cpp
+// ~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "responder.hpp"
+#include <utility>
+
+namespace http {
+namespace server {
+
+responder::state::state(deliver_function d)
+  : deliver(std::move(d))
+{
+}
+
+responder::state::~state()
+{
+  if (!sent.exchange(true))
+    deliver(reply::stock_reply(reply::internal_server_error));
+}
+
+responder::responder(deliver_function deliver)
+  : state_(std::make_shared<state>(std::move(deliver)))
+{
+}
+
+void responder::send(reply rep)
+{
+  if (state_ && !state_->sent.exchange(true))
+    state_->deliver(std::move(rep));
+}
+
+responder::operator bool() const
+{
+  return state_ && !state_->sent.load();
+}
+
+} // namespace server
+} // namespace http
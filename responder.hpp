@@ -0,0 +1,60 @@
+//
+// responder.hpp
+// ~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_RESPONDER_HPP
+#define HTTP_RESPONDER_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "reply.hpp"
+
+namespace http {
+namespace server {
+
+/// Sends the reply to a request whose handling was deferred. Copies refer to
+/// the same request. send() may be called from any thread; the reply is
+/// passed back to the connection's own thread and finished there like a
+/// synchronous reply. If every copy is destroyed without a reply having been
+/// sent, 500 Internal Server Error is sent instead, so the client is never
+/// left waiting. A responder must not outlive the server.
+class responder
+{
+public:
+  /// Function that hands the reply over to the connection.
+  typedef std::function<void(reply&& rep)> deliver_function;
+
+  /// Construct a responder that cannot send anything.
+  responder() = default;
+
+  /// Construct a responder that passes its reply to deliver.
+  explicit responder(deliver_function deliver);
+
+  /// Send the reply. Only the first call from any copy has an effect.
+  void send(reply rep);
+
+  /// Whether a reply can still be sent.
+  explicit operator bool() const;
+
+private:
+  struct state
+  {
+    explicit state(deliver_function d);
+    ~state();
+
+    deliver_function deliver;
+    std::atomic<bool> sent{false};
+  };
+
+  std::shared_ptr<state> state_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_RESPONDER_HPP
@@ -0,0 +1,221 @@
+//
+// router.cpp
+// ~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "router.hpp"
+#include <stdexcept>
+
+namespace http {
+namespace server {
+
+struct router::node
+{
+  /// Static text matched by this node; empty for the root and captures.
+  std::string prefix;
+
+  /// Static children, each starting with a different character.
+  std::vector<std::unique_ptr<node>> children;
+
+  /// Child matching one path segment, and the name it is captured under.
+  std::unique_ptr<node> param;
+  std::string param_name;
+
+  /// Child matching the rest of the path, and its capture name.
+  std::unique_ptr<node> wildcard;
+  std::string wildcard_name;
+
+  /// Handlers of the routes ending here, by method.
+  std::vector<std::pair<std::string, handler>> handlers;
+};
+
+router::node* router::insert_static(node* n, std::string_view s)
+{
+  while (!s.empty())
+  {
+    std::unique_ptr<node>* next = nullptr;
+    for (auto& c: n->children)
+    {
+      if (c->prefix[0] == s[0])
+      {
+        next = &c;
+        break;
+      }
+    }
+
+    if (!next)
+    {
+      n->children.emplace_back(new node());
+      n->children.back()->prefix.assign(s.data(), s.size());
+      return n->children.back().get();
+    }
+
+    std::unique_ptr<node>& child = *next;
+    std::size_t common = 0;
+    while (common < s.size() && common < child->prefix.size()
+        && s[common] == child->prefix[common])
+      ++common;
+
+    if (common < child->prefix.size())
+    {
+      // Split the child: the shared text moves to a new node above it.
+      std::unique_ptr<node> split(new node());
+      split->prefix = child->prefix.substr(0, common);
+      child->prefix.erase(0, common);
+      split->children.push_back(std::move(child));
+      child = std::move(split);
+    }
+
+    n = child.get();
+    s.remove_prefix(common);
+  }
+  return n;
+}
+
+bool router::select(const node& n, std::string_view method, match& m)
+{
+  for (auto& h: n.handlers)
+  {
+    if (h.first == method || h.first == "*")
+    {
+      m.target = &h.second;
+      return true;
+    }
+  }
+  if (!n.handlers.empty())
+    m.path_matched = true;
+  return false;
+}
+
+router::router()
+  : root_(new node())
+{
+}
+
+router::~router()
+{
+}
+
+void router::add(const std::string& method, const std::string& pattern,
+    handler h)
+{
+  if (pattern.empty() || pattern[0] != '/')
+    throw std::invalid_argument("route must start with '/': " + pattern);
+
+  node* n = root_.get();
+  std::size_t captures = 0;
+  std::size_t pos = 0;
+  while (pos < pattern.size())
+  {
+    std::size_t special = pattern.find_first_of(":*", pos);
+    n = insert_static(n, std::string_view(pattern).substr(pos,
+          special == std::string::npos ? std::string::npos : special - pos));
+    if (special == std::string::npos)
+      break;
+
+    if (pattern[special - 1] != '/')
+      throw std::invalid_argument("capture must start a segment: " + pattern);
+    if (++captures > max_captures)
+      throw std::invalid_argument("too many captures: " + pattern);
+
+    std::size_t name_end = pattern[special] == ':'
+      ? pattern.find('/', special) : pattern.size();
+    if (name_end == std::string::npos)
+      name_end = pattern.size();
+    std::string name = pattern.substr(special + 1, name_end - special - 1);
+    if (name.empty() || name.find_first_of(":*/") != std::string::npos)
+      throw std::invalid_argument("bad capture name: " + pattern);
+
+    std::unique_ptr<node>& child =
+      pattern[special] == ':' ? n->param : n->wildcard;
+    std::string& child_name =
+      pattern[special] == ':' ? n->param_name : n->wildcard_name;
+    if (!child)
+    {
+      child.reset(new node());
+      child_name = name;
+    }
+    else if (child_name != name)
+    {
+      throw std::invalid_argument("capture " + name + " conflicts with "
+          + child_name + ": " + pattern);
+    }
+    n = child.get();
+    pos = name_end;
+  }
+
+  for (auto& existing: n->handlers)
+  {
+    if (existing.first == method)
+    {
+      existing.second = std::move(h);
+      return;
+    }
+  }
+  n->handlers.emplace_back(method, std::move(h));
+  empty_ = false;
+}
+
+bool router::find(std::string_view method, std::string_view path,
+    match& m) const
+{
+  m.target = nullptr;
+  m.path_matched = false;
+  m.capture_count = 0;
+  return find(*root_, method, path, m);
+}
+
+bool router::find(const node& n, std::string_view method,
+    std::string_view path, match& m) const
+{
+  if (path.empty())
+  {
+    if (select(n, method, m))
+      return true;
+  }
+  else
+  {
+    // Static text first; at most one child can start with path[0].
+    for (auto& c: n.children)
+    {
+      if (c->prefix[0] == path[0])
+      {
+        if (path.compare(0, c->prefix.size(), c->prefix) == 0
+            && find(*c, method, path.substr(c->prefix.size()), m))
+          return true;
+        break;
+      }
+    }
+
+    if (n.param)
+    {
+      std::size_t end = path.find('/');
+      if (end == std::string_view::npos)
+        end = path.size();
+      if (end != 0)
+      {
+        m.captures[m.capture_count++] =
+          std::make_pair(std::string_view(n.param_name), path.substr(0, end));
+        if (find(*n.param, method, path.substr(end), m))
+          return true;
+        --m.capture_count;
+      }
+    }
+  }
+
+  if (n.wildcard)
+  {
+    m.captures[m.capture_count++] =
+      std::make_pair(std::string_view(n.wildcard_name), path);
+    if (select(*n.wildcard, method, m))
+      return true;
+    --m.capture_count;
+  }
+  return false;
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,95 @@
+//
+// router.hpp
+// ~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_ROUTER_HPP
+#define HTTP_ROUTER_HPP
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "request.hpp"
+
+namespace http {
+namespace server {
+
+struct reply;
+
+/// Maps a method and path to a handler. Patterns are made of static text,
+/// ":name" segments capturing one path segment and a final "*name" capturing
+/// the rest of the path, e.g. "/users/:id/files/*path". Patterns are kept in
+/// a compressed radix tree, so a lookup walks the path once; static text is
+/// preferred over a capture, and a segment capture over a wildcard. Matching
+/// does not allocate: captures refer into the path and the route table.
+class router
+{
+public:
+  typedef std::function<void(request& req, reply& rep)> handler;
+
+  /// Most captures a single pattern may have.
+  static const std::size_t max_captures = 8;
+
+  /// The result of a lookup.
+  struct match
+  {
+    /// The handler for the route, or null if none matched.
+    const handler* target = nullptr;
+
+    /// Set if a route has the path but not for the requested method.
+    bool path_matched = false;
+
+    /// Captured names and values, in pattern order. Values are still
+    /// URL-encoded.
+    std::array<std::pair<std::string_view, std::string_view>, max_captures>
+      captures;
+    std::size_t capture_count = 0;
+  };
+
+  router();
+  ~router();
+  router(const router&) = delete;
+  router& operator=(const router&) = delete;
+
+  /// Register a handler for a method and path pattern. A method of "*"
+  /// matches any method. Throws std::invalid_argument if the pattern is
+  /// malformed or conflicts with an existing one.
+  void add(const std::string& method, const std::string& pattern, handler h);
+
+  /// Find the handler for a request. Returns false if there is none; see
+  /// match::path_matched to tell an unknown path from an unsupported method.
+  bool find(std::string_view method, std::string_view path, match& m) const;
+
+  /// Whether any routes are registered.
+  bool empty() const { return empty_; }
+
+private:
+  struct node;
+
+  /// Descend from n along the static text s, splitting nodes where s leaves
+  /// an existing prefix, and return the node at the end of s.
+  static node* insert_static(node* n, std::string_view s);
+
+  /// Pick the handler for method among those of n.
+  static bool select(const node& n, std::string_view method, match& m);
+
+  /// Match path below n, backtracking from static text to captures.
+  bool find(const node& n, std::string_view method, std::string_view path,
+      match& m) const;
+
+  std::unique_ptr<node> root_;
+  bool empty_ = true;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_ROUTER_HPP
@@ -10,19 +10,100 @@
 
 #include "server.hpp"
 #include <signal.h>
+#include <stdexcept>
+#include <thread>
 #include <utility>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif // defined(__linux__)
+#include "mime_types.hpp"
 
 namespace http {
 namespace server {
 
+namespace {
+
+/// Number of shards requested by the options, resolving zero to the number of
+/// hardware threads.
+std::size_t shard_count(const options& opts)
+{
+  if (opts.shards != 0)
+    return opts.shards;
+  std::size_t n = std::thread::hardware_concurrency();
+  return n != 0 ? n : 1;
+}
+
+/// Pin the given thread to a single CPU. Best effort: failures are ignored and
+/// the thread keeps its default affinity.
+void pin_to_cpu(std::thread::native_handle_type thread, std::size_t index)
+{
+#if defined(__linux__)
+  std::size_t cpus = std::thread::hardware_concurrency();
+  if (cpus == 0)
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(index % cpus, &set);
+  pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+  (void)thread;
+  (void)index;
+#endif // defined(__linux__)
+}
+
+/// Pin the calling thread to a single CPU.
+void pin_current_thread_to_cpu(std::size_t index)
+{
+#if defined(__linux__)
+  pin_to_cpu(pthread_self(), index);
+#else
+  (void)index;
+#endif // defined(__linux__)
+}
+
+} // namespace
+
 server::server(const std::string& address, const std::string& port,
     const std::string& doc_root)
-  : io_context_(1),
-    signals_(io_context_),
-    acceptor_(io_context_),
-    connection_manager_(),
-    request_handler_(doc_root)
+  : server(address, port, doc_root, options())
+{
+}
+
+server::server(const std::string& address, const std::string& port,
+    const std::string& doc_root, const options& opts)
+  : options_(opts),
+    shards_(make_shards(address, port, doc_root, opts)),
+    signals_(shards_.front()->io_context())
 {
+  if (!opts.mime_types_file.empty() && !mime_types::load(opts.mime_types_file))
+    throw std::runtime_error("cannot read MIME types: "
+        + opts.mime_types_file);
+
+  if (opts.worker_threads != 0)
+  {
+    workers_.reset(new worker_pool(opts.worker_threads,
+          opts.worker_queue_limit));
+    for (auto& s: shards_)
+      s->handler().set_worker_pool(workers_.get());
+  }
+
+  if (!opts.metrics_path.empty())
+  {
+    for (auto& s: shards_)
+    {
+      metrics_.add(s->metrics());
+      s->handler().set_metrics(&metrics_);
+    }
+  }
+
+  if (opts.max_connections_per_client != 0)
+  {
+    clients_.reset(new client_limiter(opts.max_connections_per_client));
+    for (auto& s: shards_)
+      s->set_client_limiter(clients_.get());
+  }
+
   // Register to handle the signals that indicate when the server should exit.
   // It is safe to register for the same signal multiple times in a program,
   // provided all registration for the specified signal is made through Asio.
@@ -33,48 +114,50 @@ server::server(const std::string& address, const std::string& port,
 #endif // defined(SIGQUIT)
 
   do_await_stop();
+}
+
+std::vector<std::unique_ptr<shard>> server::make_shards(
+    const std::string& address, const std::string& port,
+    const std::string& doc_root, const options& opts)
+{
+  std::size_t count = shard_count(opts);
+  std::vector<std::unique_ptr<shard>> shards;
+  shards.reserve(count);
 
-  // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
-  asio::ip::tcp::resolver resolver(io_context_);
+  asio::io_context io_context;
+  asio::ip::tcp::resolver resolver(io_context);
   asio::ip::tcp::endpoint endpoint =
     *resolver.resolve(address, port).begin();
-  acceptor_.open(endpoint.protocol());
-  acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true));
-  acceptor_.bind(endpoint);
-  acceptor_.listen();
 
-  do_accept();
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    shards.emplace_back(new shard(endpoint, count > 1, doc_root, opts));
+
+    // If an ephemeral port was requested, the remaining shards must bind the
+    // port the kernel picked for the first one.
+    if (i == 0)
+      endpoint = shards.front()->local_endpoint();
+  }
+  return shards;
 }
 
 void server::run()
 {
-  // The io_context::run() call will block until all asynchronous operations
-  // have finished. While the server is running, there is always at least one
-  // asynchronous operation outstanding: the asynchronous accept call waiting
-  // for new incoming connections.
-  io_context_.run();
-}
+  std::vector<std::thread> threads;
+  threads.reserve(shards_.size() - 1);
+  for (std::size_t i = 1; i < shards_.size(); ++i)
+  {
+    threads.emplace_back([this, i]() { shards_[i]->run(); });
+    if (options_.pin_shards)
+      pin_to_cpu(threads.back().native_handle(), i);
+  }
 
-void server::do_accept()
-{
-  acceptor_.async_accept(
-      [this](std::error_code ec, asio::ip::tcp::socket socket)
-      {
-        // Check whether the server was stopped by a signal before this
-        // completion handler had a chance to run.
-        if (!acceptor_.is_open())
-        {
-          return;
-        }
-
-        if (!ec)
-        {
-          connection_manager_.start(std::make_shared<connection>(
-              std::move(socket), connection_manager_, request_handler_));
-        }
-
-        do_accept();
-      });
+  if (options_.pin_shards)
+    pin_current_thread_to_cpu(0);
+  shards_.front()->run();
+
+  for (auto& t: threads)
+    t.join();
 }
 
 void server::do_await_stop()
@@ -82,13 +165,29 @@ void server::do_await_stop()
   signals_.async_wait(
       [this](std::error_code /*ec*/, int /*signo*/)
       {
-        // The server is stopped by cancelling all outstanding asynchronous
-        // operations. Once all operations have finished the io_context::run()
-        // call will exit.
-        acceptor_.close();
-        connection_manager_.stop_all();
+        // The server is stopped by stopping every shard. Once all of a
+        // shard's operations have finished its io_context::run() call will
+        // exit.
+        for (auto& s: shards_)
+          s->stop();
       });
 }
 
 } // namespace server
 } // namespace http
+
+asio_http_server *create_asio_http_server(const std::string& address,
+                                          const std::string& port,
+                                          const std::string& doc_root)
+{
+    http::server::server* _pserver;
+    _pserver = new http::server::server(address, port, doc_root);
+    return _pserver;
+}
+
+asio_http_server *create_asio_http_server_with_options(
+    const std::string& address, const std::string& port,
+    const std::string& doc_root, const http::server::options& opts)
+{
+    return new http::server::server(address, port, doc_root, opts);
+}
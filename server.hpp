@@ -12,10 +12,15 @@
 #define HTTP_SERVER_HPP
 
 #include <asio.hpp>
+#include <memory>
 #include <string>
-#include "connection.hpp"
-#include "connection_manager.hpp"
-#include "request_handler.hpp"
+#include <utility>
+#include <vector>
+#include "client_limiter.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+#include "shard.hpp"
+#include "worker_pool.hpp"
 
 /// 方便调用者引用头文件时只引用server.hpp，这两个类在回调中要用到
 #include "inc/asio_http_server.h"
@@ -34,48 +39,93 @@ public:
   explicit server(const std::string& address, const std::string& port,
       const std::string& doc_root);
 
-  /// Run the server's io_context loop.
+  /// Construct the server with explicit options, e.g. to run several shards.
+  server(const std::string& address, const std::string& port,
+      const std::string& doc_root, const options& opts);
+
+  /// Run every shard's io_context loop. The first shard runs on the calling
+  /// thread, the others on threads of their own; returns once all have
+  /// stopped.
   void run();
 
   void set_callback(_HTTP_SERVER_CALLBACK _pfunc_callback)
   {
-      request_handler_.pfunc_callback = _pfunc_callback;
+      set_request_callback([_pfunc_callback](request& req, reply& rep)
+          { _pfunc_callback(std::move(req), rep); });
+  }
+
+  void set_callback(_HTTP_SERVER_CONTEXT_CALLBACK _pfunc_callback,
+      void* context)
+  {
+      set_request_callback([_pfunc_callback, context](request& req, reply& rep)
+          { _pfunc_callback(req, rep, context); });
+  }
+
+  void set_handler(_HTTP_SERVER_FUNCTION callback)
+  {
+      set_request_callback(request_callback(std::move(callback)));
+  }
+
+  void set_async_callback(_HTTP_SERVER_ASYNC_FUNCTION callback)
+  {
+      async_request_callback async(std::move(callback));
+      for (auto& s: shards_)
+          s->handler().pfunc_async_callback = async;
+  }
+
+  void add_route(const std::string& method, const std::string& pattern,
+      _HTTP_SERVER_FUNCTION handler)
+  {
+      request_callback callback(std::move(handler));
+      for (auto& s: shards_)
+          s->handler().add_route(method, pattern, callback);
+  }
+
+  void set_body_handler(body_handler handler)
+  {
+      for (auto& s: shards_)
+          s->handler().pfunc_body_handler = handler;
   }
 
 private:
-  /// Perform an asynchronous accept operation.
-  void do_accept();
+  /// Create the shards described by the options, all bound to one endpoint.
+  static std::vector<std::unique_ptr<shard>> make_shards(
+      const std::string& address, const std::string& port,
+      const std::string& doc_root, const options& opts);
+
+  /// Install the callback in every shard's request handler.
+  void set_request_callback(const request_callback& callback)
+  {
+      for (auto& s: shards_)
+          s->handler().pfunc_callback = callback;
+  }
 
   /// Wait for a request to stop the server.
   void do_await_stop();
 
-  /// The io_context used to perform asynchronous operations.
-  asio::io_context io_context_;
+  /// The server options.
+  options options_;
 
-  /// The signal_set is used to register for process termination notifications.
-  asio::signal_set signals_;
+  /// Connections per client, when options::max_connections_per_client is
+  /// set. Declared before shards_ so that it outlives their connections.
+  std::unique_ptr<client_limiter> clients_;
 
-  /// Acceptor used to listen for incoming connections.
-  asio::ip::tcp::acceptor acceptor_;
+  /// The metrics of all shards, served at options::metrics_path.
+  metrics_registry metrics_;
 
-  /// The connection manager which owns all live connections.
-  connection_manager connection_manager_;
+  /// The shards serving connections. There is always at least one.
+  std::vector<std::unique_ptr<shard>> shards_;
 
-  /// The handler for all incoming requests.
-  request_handler request_handler_;
+  /// Threads running the request callbacks, when options::worker_threads is
+  /// set. Declared after shards_ so that it stops before they are destroyed.
+  std::unique_ptr<worker_pool> workers_;
+
+  /// The signal_set is used to register for process termination notifications.
+  /// It lives on the first shard's io_context.
+  asio::signal_set signals_;
 };
 
 } // namespace server
 } // namespace http
 
-asio_http_server *create_asio_http_server(const std::string& address,
-                                          const std::string& port,
-                                          const std::string& doc_root)
-{
-    http::server::server* _pserver;
-    _pserver = new http::server::server(address, port, doc_root);
-    return _pserver;
-}
-
-
 #endif // HTTP_SERVER_HPP
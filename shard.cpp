@@ -0,0 +1,250 @@
+//
+// shard.cpp
+// ~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "shard.hpp"
+#include <array>
+#include <memory>
+#include <sys/socket.h>
+#include <utility>
+
+namespace http {
+namespace server {
+
+#if defined(SO_REUSEPORT)
+typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>
+  reuse_port;
+#endif // defined(SO_REUSEPORT)
+
+shard::shard(const asio::ip::tcp::endpoint& endpoint, bool reuse_port,
+    const std::string& doc_root, const options& opts)
+  : options_(opts),
+    io_context_(1),
+    timer_wheel_(io_context_, std::chrono::milliseconds(100)),
+    acceptor_(io_context_),
+    connection_manager_(metrics_, opts.connection_pool_size),
+    request_handler_(io_context_, doc_root, opts)
+{
+  // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR)
+  // and, when several shards share the endpoint, the port (SO_REUSEPORT).
+  acceptor_.open(endpoint.protocol());
+  acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+  if (reuse_port)
+  {
+#if defined(SO_REUSEPORT)
+    acceptor_.set_option(http::server::reuse_port(true));
+#endif // defined(SO_REUSEPORT)
+  }
+  acceptor_.bind(endpoint);
+  acceptor_.listen();
+
+  refusal_ = reply::stock_reply(reply::service_unavailable);
+  refusal_.headers.push_back(
+      header{"Retry-After", std::to_string(options_.retry_after.count())});
+  refusal_.headers.push_back(header{"Connection", "close"});
+
+  accept_retry_.callback = [this]()
+    {
+      if (!accepting_ && !full() && acceptor_.is_open())
+        do_accept();
+    };
+
+  // A connection closing makes room for the client and, if accepting was
+  // paused, for the shard.
+  connection_manager_.set_stop_handler(
+      [this](const asio::ip::address& client)
+      {
+        if (client_limiter_)
+          client_limiter_->release(client);
+        if (!accepting_ && !full() && acceptor_.is_open())
+          do_accept();
+      });
+
+  do_accept();
+}
+
+void shard::run()
+{
+  // The io_context::run() call will block until all asynchronous operations
+  // have finished. While the shard is running, there is always at least one
+  // asynchronous operation outstanding: the asynchronous accept call waiting
+  // for new incoming connections.
+  io_context_.run();
+}
+
+void shard::stop()
+{
+  // The shard is stopped by cancelling all outstanding asynchronous
+  // operations. The work is posted so that it runs on the shard's own thread.
+  asio::post(io_context_,
+      [this]()
+      {
+        acceptor_.close();
+        timer_wheel_.cancel(accept_retry_);
+        connection_manager_.stop_all();
+      });
+}
+
+void shard::set_client_limiter(client_limiter* limiter)
+{
+  client_limiter_ = limiter;
+}
+
+void shard::do_accept()
+{
+  accepting_ = true;
+  timer_wheel_.cancel(accept_retry_);
+  acceptor_.async_accept(peer_,
+      [this](std::error_code ec, asio::ip::tcp::socket socket)
+      {
+        // Check whether the shard was stopped before this completion handler
+        // had a chance to run.
+        if (!acceptor_.is_open())
+        {
+          return;
+        }
+
+        if (!ec)
+        {
+          admit(std::move(socket), peer_.address());
+        }
+        else if (ec == asio::error::no_descriptors
+            || ec == std::errc::too_many_files_open_in_system)
+        {
+          // Out of file descriptors: accepting again at once would fail the
+          // same way, so wait for a tick of the wheel, or for a connection
+          // to close.
+          accepting_ = false;
+          timer_wheel_.schedule(accept_retry_, std::chrono::milliseconds(100));
+          return;
+        }
+
+        // When full, leave new connections in the listen backlog until one
+        // closes, rather than accept them only to turn them away.
+        if (full() && options_.on_overload == overload_policy::pause_accept)
+        {
+          accepting_ = false;
+          return;
+        }
+
+        do_accept();
+      });
+}
+
+namespace {
+
+/// A refused socket read until the client closes it or its deadline expires.
+struct lingering_socket
+{
+  lingering_socket(asio::ip::tcp::socket s, std::size_t& count)
+    : socket(std::move(s)),
+      deadline(socket.get_executor()),
+      count(count)
+  {
+  }
+
+  asio::ip::tcp::socket socket;
+  asio::steady_timer deadline;
+  std::array<char, 1024> buffer;
+
+  /// The shard's count of lingering sockets, which includes this one.
+  std::size_t& count;
+};
+
+/// Read and discard until end of file or an error, then cancel the deadline
+/// and stop counting the socket. It is closed when the last handler
+/// referring to it is done.
+void drain(const std::shared_ptr<lingering_socket>& s)
+{
+  s->socket.async_read_some(asio::buffer(s->buffer),
+      [s](std::error_code ec, std::size_t)
+      {
+        if (!ec)
+        {
+          drain(s);
+          return;
+        }
+        s->deadline.cancel();
+        --s->count;
+      });
+}
+
+} // namespace
+
+void shard::admit(asio::ip::tcp::socket socket,
+    const asio::ip::address& client)
+{
+  if (full() || (client_limiter_ && !client_limiter_->acquire(client)))
+  {
+    refuse(std::move(socket));
+    return;
+  }
+
+  connection_manager_.start(connection_manager_.create(
+        std::move(socket), request_handler_, timer_wheel_, options_), client);
+}
+
+void shard::refuse(asio::ip::tcp::socket socket)
+{
+  // The reply fits easily into the send buffer of a new socket, so it is
+  // written at once without waiting, and without a connection object. Its
+  // header is serialised again each time for a current Date.
+  refusal_header_.clear();
+  refusal_.serialize_header(refusal_header_);
+  std::array<asio::const_buffer, 2> buffers =
+    { asio::buffer(refusal_header_), asio::buffer(*refusal_.shared_content) };
+  asio::error_code ec;
+  socket.non_blocking(true, ec);
+  std::size_t sent = socket.write_some(buffers, ec);
+  if (ec || sent != asio::buffer_size(buffers))
+  {
+    metrics_.refusals_failed.add();
+    socket.close(ec);
+    return;
+  }
+  metrics_.connections_refused.add();
+  socket.shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+
+  // Closing a socket with request bytes still unread makes the kernel reset
+  // the connection, and the client may then lose the reply. So read what has
+  // arrived, and if the client has not closed its side yet, keep reading
+  // until it does, for at most refusal_linger.
+  std::array<char, 1024> discard;
+  do
+  {
+    socket.read_some(asio::buffer(discard), ec);
+  } while (!ec);
+  if (ec != asio::error::would_block || options_.refusal_linger.count() == 0
+      || lingering_ >= options_.max_lingering_refusals)
+  {
+    socket.close(ec);
+    return;
+  }
+
+  ++lingering_;
+  auto s = std::make_shared<lingering_socket>(std::move(socket), lingering_);
+  s->deadline.expires_after(options_.refusal_linger);
+  s->deadline.async_wait(
+      [s](std::error_code ec)
+      {
+        if (!ec)
+        {
+          asio::error_code ignored_ec;
+          s->socket.close(ignored_ec);
+        }
+      });
+  drain(s);
+}
+
+bool shard::full() const
+{
+  return options_.max_connections != 0
+    && connection_manager_.size() >= options_.max_connections;
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,128 @@
+//
+// shard.hpp
+// ~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_SHARD_HPP
+#define HTTP_SHARD_HPP
+
+#include <asio.hpp>
+#include <string>
+#include "client_limiter.hpp"
+#include "connection.hpp"
+#include "connection_manager.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+#include "reply.hpp"
+#include "request_handler.hpp"
+#include "timer_wheel.hpp"
+
+namespace http {
+namespace server {
+
+/// One share-nothing slice of the server. A shard accepts, parses and answers
+/// requests entirely on the thread running its io_context, so shards never
+/// touch each other's state.
+class shard
+{
+public:
+  shard(const shard&) = delete;
+  shard& operator=(const shard&) = delete;
+
+  /// Construct a shard listening on the given endpoint. When reuse_port is set
+  /// the acceptor is opened with SO_REUSEPORT so that several shards can bind
+  /// the same endpoint and let the kernel balance connections between them.
+  shard(const asio::ip::tcp::endpoint& endpoint, bool reuse_port,
+      const std::string& doc_root, const options& opts);
+
+  /// Run the shard's io_context loop on the calling thread.
+  void run();
+
+  /// Stop accepting and close all connections. Safe to call from any thread.
+  void stop();
+
+  /// The io_context used by this shard.
+  asio::io_context& io_context() { return io_context_; }
+
+  /// The endpoint the shard's acceptor is bound to.
+  asio::ip::tcp::endpoint local_endpoint() const
+  {
+    return acceptor_.local_endpoint();
+  }
+
+  /// The handler for all requests accepted by this shard.
+  request_handler& handler() { return request_handler_; }
+
+  /// The measurements of this shard.
+  const shard_metrics& metrics() const { return metrics_; }
+
+  /// Count connections per client in the given limiter, which must outlive
+  /// the shard. Must be called before the shard runs.
+  void set_client_limiter(client_limiter* limiter);
+
+private:
+  /// Perform an asynchronous accept operation.
+  void do_accept();
+
+  /// Start a connection for an accepted socket, or refuse it if the shard or
+  /// the client has too many.
+  void admit(asio::ip::tcp::socket socket, const asio::ip::address& client);
+
+  /// Answer an accepted socket with 503 Service Unavailable and close it
+  /// once the client has closed its side or refusal_linger has passed.
+  void refuse(asio::ip::tcp::socket socket);
+
+  /// Whether the shard has max_connections open.
+  bool full() const;
+
+  /// The options this shard was created with.
+  options options_;
+
+  /// The io_context used to perform asynchronous operations.
+  asio::io_context io_context_;
+
+  /// Timeouts of the connections of this shard.
+  timer_wheel timer_wheel_;
+
+  /// Acceptor used to listen for incoming connections.
+  asio::ip::tcp::acceptor acceptor_;
+
+  /// The address of the connection being accepted.
+  asio::ip::tcp::endpoint peer_;
+
+  /// Set while an accept operation is outstanding; cleared while accepting
+  /// is paused because the shard is full or out of file descriptors.
+  bool accepting_ = false;
+
+  /// Resumes accepting a while after it ran out of file descriptors.
+  timer_wheel::entry accept_retry_;
+
+  /// Number of refused sockets being drained before they are closed.
+  std::size_t lingering_ = 0;
+
+  /// The reply sent to refused connections, made once.
+  reply refusal_;
+
+  /// The serialised header of refusal_, reused from one refusal to the next.
+  std::string refusal_header_;
+
+  /// Counts connections per client across shards, if they are limited.
+  client_limiter* client_limiter_ = nullptr;
+
+  /// Counters and histograms of this shard's connections.
+  shard_metrics metrics_;
+
+  /// The connection manager which owns all live connections of this shard.
+  connection_manager connection_manager_;
+
+  /// The handler for all incoming requests.
+  request_handler request_handler_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_SHARD_HPP
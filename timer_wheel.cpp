@@ -0,0 +1,180 @@
+//
+// timer_wheel.cpp
+// ~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "timer_wheel.hpp"
+
+namespace http {
+namespace server {
+
+timer_wheel::entry::~entry()
+{
+  if (next_ && wheel_)
+    wheel_->unlink(*this);
+}
+
+timer_wheel::timer_wheel(asio::io_context& io_context,
+    std::chrono::milliseconds resolution)
+  : timer_(io_context),
+    resolution_(resolution),
+    origin_(std::chrono::steady_clock::now())
+{
+  for (auto& head: heads_)
+    head.next_ = head.prev_ = &head;
+}
+
+timer_wheel::~timer_wheel()
+{
+  // Entries may outlive the wheel; leave them unscheduled so that they do
+  // not touch it.
+  for (auto& head: heads_)
+  {
+    entry* e = head.next_;
+    while (e != &head)
+    {
+      entry* next = e->next_;
+      e->next_ = e->prev_ = nullptr;
+      e->wheel_ = nullptr;
+      e = next;
+    }
+    head.next_ = head.prev_ = nullptr;
+  }
+}
+
+void timer_wheel::schedule(entry& e, std::chrono::milliseconds timeout)
+{
+  if (e.scheduled())
+    unlink(e);
+
+  // The clock is not followed while nothing is scheduled.
+  if (size_ == 0)
+    now_ = current_tick();
+
+  std::chrono::steady_clock::duration d = timeout;
+  std::uint64_t ticks = static_cast<std::uint64_t>(
+      (d + resolution_ - std::chrono::steady_clock::duration(1))
+      / resolution_);
+  e.wheel_ = this;
+  e.expiry_ = now_ + (ticks != 0 ? ticks : 1);
+  insert(e);
+  start_timer();
+}
+
+void timer_wheel::cancel(entry& e)
+{
+  if (e.scheduled())
+    unlink(e);
+}
+
+void timer_wheel::insert(entry& e)
+{
+  // Timeouts beyond the top level wait as long as it allows.
+  std::uint64_t span = std::uint64_t(1) << (slot_bits * levels);
+  if (e.expiry_ - now_ >= span)
+    e.expiry_ = now_ + span - 1;
+
+  // The lowest level whose span covers the timeout.
+  std::uint64_t delta = e.expiry_ - now_;
+  std::size_t level = 0;
+  while (delta >= std::uint64_t(1) << (slot_bits * (level + 1)))
+    ++level;
+
+  std::size_t index = (e.expiry_ >> (slot_bits * level)) & (slots - 1);
+  entry& head = heads_[level * slots + index];
+  e.prev_ = head.prev_;
+  e.next_ = &head;
+  head.prev_->next_ = &e;
+  head.prev_ = &e;
+  ++size_;
+}
+
+void timer_wheel::unlink(entry& e)
+{
+  e.prev_->next_ = e.next_;
+  e.next_->prev_ = e.prev_;
+  e.next_ = e.prev_ = nullptr;
+  --size_;
+}
+
+void timer_wheel::take(entry& head, entry& list)
+{
+  if (head.next_ == &head)
+  {
+    list.next_ = list.prev_ = &list;
+    return;
+  }
+  list.next_ = head.next_;
+  list.prev_ = head.prev_;
+  list.next_->prev_ = &list;
+  list.prev_->next_ = &list;
+  head.next_ = head.prev_ = &head;
+}
+
+void timer_wheel::tick()
+{
+  ++now_;
+
+  // Each time a level wraps around, the next slot of the level above is due
+  // to be spread over the levels below.
+  for (std::size_t level = 1; level < levels; ++level)
+  {
+    std::uint64_t mask = (std::uint64_t(1) << (slot_bits * level)) - 1;
+    if ((now_ & mask) != 0)
+      break;
+    std::size_t index = (now_ >> (slot_bits * level)) & (slots - 1);
+    entry moved;
+    take(heads_[level * slots + index], moved);
+    while (moved.next_ != &moved)
+    {
+      entry& e = *moved.next_;
+      unlink(e);
+      insert(e);
+    }
+  }
+
+  // Entries are unlinked before their callback runs, so the callback may
+  // schedule or cancel any entry, its own included.
+  entry due;
+  take(heads_[now_ & (slots - 1)], due);
+  while (due.next_ != &due)
+  {
+    entry& e = *due.next_;
+    unlink(e);
+    e.callback();
+  }
+}
+
+std::uint64_t timer_wheel::current_tick() const
+{
+  return static_cast<std::uint64_t>(
+      (std::chrono::steady_clock::now() - origin_) / resolution_);
+}
+
+void timer_wheel::start_timer()
+{
+  if (waiting_ || size_ == 0)
+    return;
+
+  waiting_ = true;
+  timer_.expires_at(origin_ + resolution_ * (now_ + 1));
+  timer_.async_wait(
+      [this](std::error_code ec)
+      {
+        // The wait is only aborted when the wheel is destroyed.
+        if (ec)
+          return;
+
+        waiting_ = false;
+        std::uint64_t target = current_tick();
+        while (now_ < target && size_ != 0)
+          tick();
+        start_timer();
+      });
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,116 @@
+//
+// timer_wheel.hpp
+// ~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_TIMER_WHEEL_HPP
+#define HTTP_TIMER_WHEEL_HPP
+
+#include <array>
+#include <asio.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace http {
+namespace server {
+
+/// Timeouts for many objects driven by a single steady_timer. Time advances in
+/// ticks of a fixed resolution; timeouts are kept in a hierarchical wheel of
+/// levels slots each, so scheduling, cancelling and expiring an entry take
+/// constant time. Entries are intrusive: the object timed out owns its entry,
+/// and the wheel only links entries together, so it never allocates.
+///
+/// The wheel is used from the thread running its io_context only. It keeps
+/// the io_context busy only while entries are scheduled.
+class timer_wheel
+{
+public:
+  /// A timeout that can be scheduled on the wheel. The callback is set once
+  /// by the owner and called on expiry, after the entry has been unlinked.
+  /// Destroying a scheduled entry cancels it.
+  class entry
+  {
+  public:
+    entry() = default;
+    entry(const entry&) = delete;
+    entry& operator=(const entry&) = delete;
+    ~entry();
+
+    /// Whether the entry is scheduled.
+    bool scheduled() const { return next_ != nullptr; }
+
+    std::function<void()> callback;
+
+  private:
+    friend class timer_wheel;
+
+    entry* prev_ = nullptr;
+    entry* next_ = nullptr;
+    timer_wheel* wheel_ = nullptr;
+    std::uint64_t expiry_ = 0;
+  };
+
+  timer_wheel(const timer_wheel&) = delete;
+  timer_wheel& operator=(const timer_wheel&) = delete;
+
+  /// Construct a wheel advancing in ticks of the given resolution.
+  timer_wheel(asio::io_context& io_context,
+      std::chrono::milliseconds resolution);
+
+  /// Unlink all entries without calling them.
+  ~timer_wheel();
+
+  /// Schedule e to expire after timeout, rounded up to whole ticks.
+  /// Replaces any earlier schedule of e.
+  void schedule(entry& e, std::chrono::milliseconds timeout);
+
+  /// Unschedule e, if it is scheduled.
+  void cancel(entry& e);
+
+  /// Number of scheduled entries.
+  std::size_t size() const { return size_; }
+
+private:
+  static const unsigned slot_bits = 6;
+  static const std::size_t slots = std::size_t(1) << slot_bits;
+  static const std::size_t levels = 4;
+
+  /// Link e into the slot for its expiry, relative to the current tick.
+  void insert(entry& e);
+
+  /// Unlink e from whatever list it is in.
+  void unlink(entry& e);
+
+  /// Move the entries of one slot into list, an empty list head.
+  void take(entry& head, entry& list);
+
+  /// Advance by one tick: move entries down from the higher levels, then
+  /// expire those due now.
+  void tick();
+
+  /// The tick the steady clock is in now.
+  std::uint64_t current_tick() const;
+
+  /// Wait for the next tick, unless already waiting.
+  void start_timer();
+
+  asio::steady_timer timer_;
+  std::chrono::steady_clock::duration resolution_;
+  std::chrono::steady_clock::time_point origin_;
+  std::uint64_t now_ = 0;
+  std::size_t size_ = 0;
+  bool waiting_ = false;
+
+  /// List heads, level by level. Each is the sentinel of a circular list.
+  std::array<entry, slots * levels> heads_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_TIMER_WHEEL_HPP
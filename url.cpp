@@ -0,0 +1,209 @@
+//
+// url.cpp
+// ~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "url.hpp"
+#include <cstring>
+#include "char_scan.hpp"
+
+namespace http {
+namespace server {
+namespace url {
+
+namespace {
+
+/// Marks a byte that is not a hex digit in hex_table.
+const unsigned char not_hex = 0xff;
+
+/// The value of each byte as a hex digit.
+struct hex_table
+{
+  constexpr hex_table()
+    : value()
+  {
+    for (int i = 0; i < 256; ++i)
+      value[i] = not_hex;
+    for (int i = 0; i < 10; ++i)
+      value['0' + i] = static_cast<unsigned char>(i);
+    for (int i = 0; i < 6; ++i)
+    {
+      value['a' + i] = static_cast<unsigned char>(10 + i);
+      value['A' + i] = static_cast<unsigned char>(10 + i);
+    }
+  }
+
+  unsigned char value[256];
+};
+
+constexpr hex_table hex;
+
+/// The byte a valid escape at p, which must have two bytes after the '%',
+/// stands for, or -1.
+int escaped_byte(const char* p)
+{
+  unsigned char high = hex.value[static_cast<unsigned char>(p[1])];
+  unsigned char low = hex.value[static_cast<unsigned char>(p[2])];
+  if (high == not_hex || low == not_hex)
+    return -1;
+  return (high << 4) | low;
+}
+
+/// Decode [in, in + size) into out, which may be in itself. Runs without
+/// escapes are found with a vector scan and copied whole. Returns the
+/// decoded size, or npos if strict and an escape is malformed.
+std::size_t decode_into(const char* in, std::size_t size, char* out,
+    bool strict)
+{
+  const char* end = in + size;
+  char* o = out;
+  for (;;)
+  {
+    const char* special = char_scan::find_either(in, end, '%', '+');
+    std::size_t run = static_cast<std::size_t>(special - in);
+    if (run != 0 && o != in)
+      std::memmove(o, in, run);
+    o += run;
+    in = special;
+    if (in == end)
+      break;
+
+    if (*in == '+')
+    {
+      *o++ = ' ';
+      ++in;
+      continue;
+    }
+
+    int byte = end - in >= 3 ? escaped_byte(in) : -1;
+    if (byte >= 0)
+    {
+      *o++ = static_cast<char>(byte);
+      in += 3;
+    }
+    else if (strict)
+    {
+      return std::string::npos;
+    }
+    else
+    {
+      *o++ = *in++;
+    }
+  }
+  return static_cast<std::size_t>(o - out);
+}
+
+bool decode(std::string_view in, std::string& out, bool strict)
+{
+  // Decoding never makes the text longer, so out is sized once.
+  out.resize(in.size());
+  std::size_t size = decode_into(in.data(), in.size(), &out[0], strict);
+  if (size == std::string::npos)
+    return false;
+  out.resize(size);
+  return true;
+}
+
+} // namespace
+
+bool decode(std::string_view in, std::string& out)
+{
+  return decode(in, out, true);
+}
+
+void decode_lenient(std::string_view in, std::string& out)
+{
+  decode(in, out, false);
+}
+
+std::size_t decode_in_place(char* data, std::size_t size)
+{
+  return decode_into(data, size, data, true);
+}
+
+} // namespace url
+
+void query_params::parse(std::string_view query)
+{
+  params_.clear();
+  split(query,
+      [this](std::string_view key, std::string_view value)
+      {
+        params_.push_back(param{key, value});
+      });
+}
+
+std::string query_params::decode(std::string_view encoded)
+{
+  std::string decoded;
+  url::decode_lenient(encoded, decoded);
+  return decoded;
+}
+
+bool query_params::find(std::string_view key, std::string& value) const
+{
+  for (const param& p: params_)
+  {
+    if (key_equals(p.key, key))
+    {
+      url::decode_lenient(p.value, value);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::size_t query_params::find_all(std::string_view key,
+    std::vector<std::string>& values) const
+{
+  std::size_t found = 0;
+  for (const param& p: params_)
+  {
+    if (key_equals(p.key, key))
+    {
+      values.push_back(decode(p.value));
+      ++found;
+    }
+  }
+  return found;
+}
+
+bool query_params::key_equals(std::string_view encoded, std::string_view key)
+{
+  // Most keys have nothing to decode.
+  if (encoded.size() == key.size() && encoded == key)
+    return true;
+
+  std::size_t k = 0;
+  for (std::size_t i = 0; i < encoded.size(); ++k)
+  {
+    if (k == key.size())
+      return false;
+    char c = encoded[i];
+    int byte;
+    if (c == '+')
+    {
+      c = ' ';
+      ++i;
+    }
+    else if (c == '%' && encoded.size() - i >= 3
+        && (byte = url::escaped_byte(encoded.data() + i)) >= 0)
+    {
+      c = static_cast<char>(byte);
+      i += 3;
+    }
+    else
+    {
+      ++i;
+    }
+    if (c != key[k])
+      return false;
+  }
+  return k == key.size();
+}
+
+} // namespace server
+} // namespace http
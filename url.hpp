@@ -0,0 +1,113 @@
+//
+// url.hpp
+// ~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_URL_HPP
+#define HTTP_URL_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace http {
+namespace server {
+namespace url {
+
+/// Decode %XX escapes, and '+' as a space, from in into out, replacing its
+/// contents. Returns false, leaving out unspecified, if an escape is
+/// malformed.
+bool decode(std::string_view in, std::string& out);
+
+/// Decode like decode(), but keep a malformed escape as it is instead of
+/// failing, as browsers do for query strings.
+void decode_lenient(std::string_view in, std::string& out);
+
+/// Decode [data, data + size) in place, like decode(). Returns the decoded
+/// size, which is never larger, or std::string::npos, leaving the data
+/// unspecified, if an escape is malformed.
+std::size_t decode_in_place(char* data, std::size_t size);
+
+} // namespace url
+
+/// The parameters of a query string such as "a=1&b=x%20y&a=2", in order and
+/// with repeated keys kept. Keys and values refer into the query string, which
+/// must outlive this object, and are decoded only when asked for.
+class query_params
+{
+public:
+  /// A parameter as it appears in the query, still encoded.
+  struct param
+  {
+    std::string_view key;
+    std::string_view value;
+  };
+
+  typedef std::vector<param>::const_iterator const_iterator;
+
+  query_params() = default;
+
+  explicit query_params(std::string_view query)
+  {
+    parse(query);
+  }
+
+  /// Split a query into its parameters, replacing any held before. Empty
+  /// parameters ("a=1&&b=2") are skipped; one without '=' has an empty value.
+  void parse(std::string_view query);
+
+  /// Call f(key, value) for each parameter of a query, still encoded, without
+  /// storing them.
+  template <typename Function>
+  static void split(std::string_view query, Function f)
+  {
+    while (!query.empty())
+    {
+      std::size_t amp = query.find('&');
+      std::string_view item = query.substr(0, amp);
+      query = amp == std::string_view::npos
+        ? std::string_view() : query.substr(amp + 1);
+      if (item.empty())
+        continue;
+      std::size_t eq = item.find('=');
+      if (eq == std::string_view::npos)
+        f(item, std::string_view());
+      else
+        f(item.substr(0, eq), item.substr(eq + 1));
+    }
+  }
+
+  std::size_t size() const { return params_.size(); }
+  bool empty() const { return params_.empty(); }
+  const param& operator[](std::size_t i) const { return params_[i]; }
+  const_iterator begin() const { return params_.begin(); }
+  const_iterator end() const { return params_.end(); }
+
+  /// Decode a key or value, leniently.
+  static std::string decode(std::string_view encoded);
+
+  /// Get the decoded value of the first parameter whose decoded key is key.
+  /// Returns false if there is none.
+  bool find(std::string_view key, std::string& value) const;
+
+  /// Append the decoded values of all parameters whose decoded key is key,
+  /// in order, to values. Returns the number appended.
+  std::size_t find_all(std::string_view key,
+      std::vector<std::string>& values) const;
+
+private:
+  /// Whether an encoded key decodes to key, found without decoding it into
+  /// memory.
+  static bool key_equals(std::string_view encoded, std::string_view key);
+
+  std::vector<param> params_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_URL_HPP
@@ -0,0 +1,69 @@
+//
+// worker_pool.cpp
+// ~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "worker_pool.hpp"
+#include <utility>
+
+namespace http {
+namespace server {
+
+worker_pool::worker_pool(std::size_t threads, std::size_t max_queued)
+  : max_queued_(max_queued)
+{
+  threads_.reserve(threads);
+  for (std::size_t i = 0; i < threads; ++i)
+    threads_.emplace_back([this]() { run(); });
+}
+
+worker_pool::~worker_pool()
+{
+  std::deque<std::function<void()>> dropped;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    dropped.swap(jobs_);
+  }
+  ready_.notify_all();
+  for (auto& t: threads_)
+    t.join();
+  // dropped is destroyed here, outside the lock, since destroying a job may
+  // answer its request.
+}
+
+bool worker_pool::post(std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_ || threads_.empty()
+        || (max_queued_ != 0 && jobs_.size() >= max_queued_))
+      return false;
+    jobs_.push_back(std::move(job));
+  }
+  ready_.notify_one();
+  return true;
+}
+
+void worker_pool::run()
+{
+  for (;;)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+      if (stopping_)
+        return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    job();
+  }
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,58 @@
+//
+// worker_pool.hpp
+// ~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_WORKER_POOL_HPP
+#define HTTP_WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace http {
+namespace server {
+
+/// A fixed set of threads running callbacks that may block, so that they do
+/// not hold up the shards' io_contexts. The queue of waiting jobs is bounded:
+/// when it is full, post() refuses the job and the caller answers the
+/// request itself.
+class worker_pool
+{
+public:
+  worker_pool(const worker_pool&) = delete;
+  worker_pool& operator=(const worker_pool&) = delete;
+
+  /// Start the given number of threads, accepting at most max_queued jobs
+  /// that are waiting for a thread. A max_queued of zero means no limit.
+  worker_pool(std::size_t threads, std::size_t max_queued);
+
+  /// Stop the threads. Jobs still queued are destroyed without being run.
+  ~worker_pool();
+
+  /// Queue a job. Returns false if the queue is full or the pool is stopping.
+  bool post(std::function<void()> job);
+
+private:
+  /// Run jobs until the pool is stopped.
+  void run();
+
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::function<void()>> jobs_;
+  std::size_t max_queued_;
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_WORKER_POOL_HPP